@@ -31,12 +31,28 @@ constexpr UInt64 AGP_DISABLE_ADDR = 0xFFFFFFFF;
 
 constexpr UInt32 AMDGPU_MAX_USEC_TIMEOUT = 100000;
 
+//! A bit field of a register, masks and shifts are derived from the position and width
+template<UInt32 Reg, UInt32 Shift, UInt32 Width>
+struct RegField {
+    static constexpr UInt32 reg() { return Reg; }
+    static constexpr UInt32 shift() { return Shift; }
+    static constexpr UInt32 mask() { return (Width >= 32 ? 0xFFFFFFFF : ((1U << Width) - 1)) << Shift; }
+    static constexpr UInt32 get(UInt32 regValue) { return (regValue & mask()) >> Shift; }
+    static constexpr UInt32 encode(UInt32 value) { return (value << Shift) & mask(); }
+    static constexpr UInt32 set(UInt32 regValue, UInt32 value) { return (regValue & ~mask()) | encode(value); }
+};
+
 //-------- SMU 8 Registers --------//
 
 constexpr UInt32 mmMP1_SMN_C2PMSG_90 = 0x29A;
 constexpr UInt32 mmMP1_SMN_C2PMSG_82 = 0x292;
 constexpr UInt32 mmMP1_SMN_C2PMSG_66 = 0x282;
 
+//! smu_8_0_d.h, Carrizo/Stoney SMU mailbox 0
+constexpr UInt32 mmSMU_MP1_SRBM2P_MSG_0 = 0x1CE;
+constexpr UInt32 mmSMU_MP1_SRBM2P_RESP_0 = 0x1DE;
+constexpr UInt32 mmSMU_MP1_SRBM2P_ARG_0 = 0x1EE;
+
 constexpr UInt32 mmMP0PUB_IND_INDEX = 0x180;
 constexpr UInt32 mmMP0PUB_IND_DATA = 0x181;
 
@@ -49,6 +65,8 @@ constexpr UInt32 mmCONFIG_MEMSIZE = 0x150A;
 constexpr UInt32 mmCONFIG_APER_SIZE = 0x150C;    //! Why does AMDGPU not use this?
 
 constexpr UInt32 mmINTERRUPT_CNTL = 0x151A;
+using INTERRUPT_CNTL__IH_DUMMY_RD_OVERRIDE_FIELD = RegField<mmINTERRUPT_CNTL, 0, 1>;
+using INTERRUPT_CNTL__IH_REQ_NONSNOOP_EN_FIELD = RegField<mmINTERRUPT_CNTL, 3, 1>;
 constexpr UInt32 mmINTERRUPT_CNTL2 = 0x151B;
 
 //-------- GFX 7/GFX 8 Registers --------//
@@ -56,6 +74,7 @@ constexpr UInt32 mmINTERRUPT_CNTL2 = 0x151B;
 constexpr UInt32 mmCHUB_CONTROL = 0x619;
 constexpr UInt32 bypassVM = (1 << 0);
 
+constexpr UInt32 mmSRBM_STATUS2 = 0x393;
 constexpr UInt32 mmSRBM_STATUS = 0x394;
 
 constexpr UInt32 SRBM_STATUS__MCB_BUSY_MASK = 0x200;
@@ -67,8 +86,21 @@ constexpr UInt32 mmSRBM_SOFT_RESET = 0x398;
 
 constexpr UInt32 SRBM_SOFT_RESET__SOFT_RESET_MC_MASK = 0x800;
 
+constexpr UInt32 mmGRBM_STATUS2 = 0x2002;
+constexpr UInt32 mmGRBM_STATUS = 0x2004;
+using GRBM_STATUS__GUI_ACTIVE = RegField<mmGRBM_STATUS, 31, 1>;
+
+constexpr UInt32 mmCP_STAT = 0x21A0;
+constexpr UInt32 mmCP_ME_CNTL = 0x21B6;
+constexpr UInt32 mmCP_RB0_RPTR = 0x21C0;
+constexpr UInt32 mmCP_RB0_BASE = 0x3040;
+constexpr UInt32 mmCP_RB0_CNTL = 0x3041;
+constexpr UInt32 mmCP_RB0_WPTR = 0x3045;
+
 //-------- GMC Registers --------//
 
+constexpr UInt32 mmVM_CONTEXT1_PROTECTION_FAULT_STATUS = 0x537;
+constexpr UInt32 mmVM_CONTEXT1_PROTECTION_FAULT_ADDR = 0x53F;
 constexpr UInt32 mmVM_CONTEXT0_PROTECTION_FAULT_DEFAULT_ADDR = 0x546;
 constexpr UInt32 mmMC_VM_FB_LOCATION = 0x809;
 constexpr UInt32 mmMC_VM_AGP_TOP = 0x80A;
@@ -87,14 +119,23 @@ constexpr UInt32 mmVM_CONTEXT1_PAGE_TABLE_END_ADDR = 0x560;
 //-------- OSS 3.0.1/IH Registers --------//
 
 constexpr UInt32 mmIH_RB_CNTL = 0xE30;
-constexpr UInt32 IH_RB_CNTL__RB_ENABLE = 0x00000001;
+using IH_RB_CNTL__RB_ENABLE_FIELD = RegField<mmIH_RB_CNTL, 0, 1>;
+constexpr UInt32 IH_RB_CNTL__RB_ENABLE = IH_RB_CNTL__RB_ENABLE_FIELD::mask();
+using IH_RB_CNTL__RB_SIZE_FIELD = RegField<mmIH_RB_CNTL, 1, 5>;
+using IH_RB_CNTL__WPTR_WRITEBACK_ENABLE_FIELD = RegField<mmIH_RB_CNTL, 8, 1>;
+using IH_RB_CNTL__WPTR_OVERFLOW_ENABLE_FIELD = RegField<mmIH_RB_CNTL, 16, 1>;
+using IH_RB_CNTL__WPTR_OVERFLOW_CLEAR_FIELD = RegField<mmIH_RB_CNTL, 31, 1>;
 constexpr UInt32 mmIH_RB_BASE = 0xE31;
 constexpr UInt32 mmIH_RB_RPTR = 0xE32;
 constexpr UInt32 mmIH_RB_WPTR = 0xE33;
+using IH_RB_WPTR__RB_OVERFLOW_FIELD = RegField<mmIH_RB_WPTR, 0, 1>;
 constexpr UInt32 mmIH_RB_WPTR_ADDR_HI = 0xE34;
 constexpr UInt32 mmIH_RB_WPTR_ADDR_LO = 0xE35;
 constexpr UInt32 mmIH_CNTL = 0xE36;
-constexpr UInt32 IH_CNTL__ENABLE_INTR = 0x00000001;
+using IH_CNTL__ENABLE_INTR_FIELD = RegField<mmIH_CNTL, 0, 1>;
+constexpr UInt32 IH_CNTL__ENABLE_INTR = IH_CNTL__ENABLE_INTR_FIELD::mask();
+using IH_CNTL__RPTR_REARM_FIELD = RegField<mmIH_CNTL, 4, 1>;
+using IH_CNTL__MC_VMID_FIELD = RegField<mmIH_CNTL, 25, 4>;
 constexpr UInt32 mmIH_LEVEL_STATUS = 0xE37;
 constexpr UInt32 mmIH_STATUS = 0xE38;
 
@@ -0,0 +1,133 @@
+//! Copyright © 2024 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.5.
+//! See LICENSE for details.
+
+#pragma once
+#include "AMDCommon.hpp"
+#include <Headers/kern_util.hpp>
+
+//! GFX core codenames
+enum struct ChipType : UInt32 {
+    Spectre = 0,    //! Kaveri
+    Spooky,         //! Kaveri 2? downgraded from Spectre core
+    Kalindi,        //! Kabini/Bhavani
+    Godavari,       //! Mullins
+    Carrizo,
+    Stoney,
+    Unknown,
+};
+
+//! Front-end consumer names, includes non-consumer names as-well
+enum struct ChipVariant : UInt32 {
+    Kaveri = 0,
+    Kabini,
+    Temash,
+    Bhavani,
+    Mullins,
+    Carrizo,
+    Bristol,    //! Bristol is actually just a Carrizo+, hence why it isn't in ChipType
+    Stoney,
+    Unknown,
+};
+
+//! Where the internal revision of an ASIC is read from
+enum struct RevisionSource : UInt8 {
+    None = 0,
+    Strap,    //! Bits 28-31 of 0x1559, GFX 7
+    SMC,      //! Bits 9-12 of SMC 0xC0014044, GFX 8
+};
+
+constexpr UInt8 ANY_REVISION = 0xFF;
+
+//! Which of HWLibs' PowerTune implementations drives the ASIC
+enum struct PowerTuneVariant : UInt8 {
+    Hawaii = 0,    //! `AtiAppleHawaiiPowerTuneServices`, GFX 7
+    Tonga,         //! `AtiAppleTongaPowerTuneServices`, GFX 8
+};
+
+struct ASICDescriptor {
+    UInt16 deviceIdLow, deviceIdHigh;
+    UInt8 pciRevisionLow, pciRevisionHigh;
+    RevisionSource revisionSource;
+    UInt8 revision;
+    UInt32 familyId;
+    ChipType chipType;
+    ChipVariant chipVariant;
+    UInt16 enumeratedRevision;
+    UInt8 maxCUCount;
+    PowerTuneVariant powerTune;
+    //! Why not inject VCE & UVD firmware on Godavari and lower ASICs?
+    //! Because the firmware is the exact same.
+    //! I'm serious, they use the same binary.
+    const char *vcePrefix;
+    const char *uvdPrefix;
+    //! Used when Model.hpp has no name for the device/revision pair
+    const char *fallbackBranding;
+};
+
+//! Rows are matched in order, so more specific rows must come before the catch-all ones.
+//! Who thought it would be a good idea to use this many Device IDs and Revisions?
+static constexpr ASICDescriptor asicTable[] = {
+    {0x1312, 0x1312, 0x00, 0xFF, RevisionSource::None, ANY_REVISION, AMDGPU_FAMILY_KV, ChipType::Spooky,
+        ChipVariant::Kaveri, 0x41, 8, PowerTuneVariant::Hawaii, "ativce02", "ativvaxy_cik", "AMD Radeon R Graphics"},
+    {0x1316, 0x1317, 0x00, 0xFF, RevisionSource::None, ANY_REVISION, AMDGPU_FAMILY_KV, ChipType::Spooky,
+        ChipVariant::Kaveri, 0x41, 8, PowerTuneVariant::Hawaii, "ativce02", "ativvaxy_cik", "AMD Radeon R Graphics"},
+    {0x1309, 0x131D, 0x00, 0xFF, RevisionSource::Strap, ANY_REVISION, AMDGPU_FAMILY_KV, ChipType::Spectre,
+        ChipVariant::Kaveri, 0x1, 8, PowerTuneVariant::Hawaii, "ativce02", "ativvaxy_cik", "AMD Radeon R Graphics"},
+    //! 0x983A-0x983C are branded "R" instead of "HD 8XXX", the rows are otherwise identical to the ones below
+    {0x983A, 0x983C, 0x00, 0xFF, RevisionSource::Strap, 0x00, AMDGPU_FAMILY_KV, ChipType::Kalindi,
+        ChipVariant::Kabini, 0x81, 2, PowerTuneVariant::Hawaii, "ativce02", "ativvaxy_cik", "AMD Radeon R Graphics"},
+    {0x983A, 0x983C, 0x00, 0xFF, RevisionSource::Strap, 0x01, AMDGPU_FAMILY_KV, ChipType::Kalindi,
+        ChipVariant::Kabini, 0x82, 2, PowerTuneVariant::Hawaii, "ativce02", "ativvaxy_cik", "AMD Radeon R Graphics"},
+    {0x983A, 0x983C, 0x00, 0xFF, RevisionSource::Strap, 0x02, AMDGPU_FAMILY_KV, ChipType::Kalindi,
+        ChipVariant::Bhavani, 0x85, 2, PowerTuneVariant::Hawaii, "ativce02", "ativvaxy_cik", "AMD Radeon R Graphics"},
+    {0x9830, 0x983D, 0x00, 0xFF, RevisionSource::Strap, 0x00, AMDGPU_FAMILY_KV, ChipType::Kalindi,
+        ChipVariant::Kabini, 0x81, 2, PowerTuneVariant::Hawaii, "ativce02", "ativvaxy_cik", "AMD Radeon HD 8XXX"},
+    {0x9830, 0x983D, 0x00, 0xFF, RevisionSource::Strap, 0x01, AMDGPU_FAMILY_KV, ChipType::Kalindi,
+        ChipVariant::Kabini, 0x82, 2, PowerTuneVariant::Hawaii, "ativce02", "ativvaxy_cik", "AMD Radeon HD 8XXX"},
+    {0x9830, 0x983D, 0x00, 0xFF, RevisionSource::Strap, 0x02, AMDGPU_FAMILY_KV, ChipType::Kalindi,
+        ChipVariant::Bhavani, 0x85, 2, PowerTuneVariant::Hawaii, "ativce02", "ativvaxy_cik", "AMD Radeon HD 8XXX"},
+    {0x9850, 0x9856, 0x00, 0xFF, RevisionSource::Strap, ANY_REVISION, AMDGPU_FAMILY_KV, ChipType::Godavari,
+        ChipVariant::Mullins, 0xA1, 2, PowerTuneVariant::Hawaii, "ativce02", "ativvaxy_cik", "AMD Radeon R Graphics"},
+    {0x9874, 0x9874, 0xC8, 0xCE, RevisionSource::SMC, ANY_REVISION, AMDGPU_FAMILY_CZ, ChipType::Carrizo,
+        ChipVariant::Bristol, 0x1, 8, PowerTuneVariant::Tonga, "amde31a", "ativvaxy_cz", "AMD Radeon R Graphics"},
+    {0x9874, 0x9874, 0xE1, 0xE6, RevisionSource::SMC, ANY_REVISION, AMDGPU_FAMILY_CZ, ChipType::Carrizo,
+        ChipVariant::Bristol, 0x1, 8, PowerTuneVariant::Tonga, "amde31a", "ativvaxy_cz", "AMD Radeon R Graphics"},
+    {0x9874, 0x9874, 0x00, 0xFF, RevisionSource::SMC, ANY_REVISION, AMDGPU_FAMILY_CZ, ChipType::Carrizo,
+        ChipVariant::Carrizo, 0x1, 8, PowerTuneVariant::Tonga, "amde31a", "ativvaxy_cz", "AMD Radeon R Graphics"},
+    //! R4 and up iGPUs have 3 compute units while the others have 2 CUs, hence the chip variations
+    {0x98E4, 0x98E4, 0x00, 0x81, RevisionSource::SMC, ANY_REVISION, AMDGPU_FAMILY_CZ, ChipType::Stoney,
+        ChipVariant::Stoney, 0x61, 3, PowerTuneVariant::Tonga, "amde34a", "ativvaxy_stn", "AMD Radeon R Graphics"},
+    {0x98E4, 0x98E4, 0xC0, 0xCF, RevisionSource::SMC, ANY_REVISION, AMDGPU_FAMILY_CZ, ChipType::Stoney,
+        ChipVariant::Stoney, 0x61, 3, PowerTuneVariant::Tonga, "amde34a", "ativvaxy_stn", "AMD Radeon R Graphics"},
+    {0x98E4, 0x98E4, 0xD9, 0xDA, RevisionSource::SMC, ANY_REVISION, AMDGPU_FAMILY_CZ, ChipType::Stoney,
+        ChipVariant::Stoney, 0x61, 3, PowerTuneVariant::Tonga, "amde34a", "ativvaxy_stn", "AMD Radeon R Graphics"},
+    {0x98E4, 0x98E4, 0xE9, 0xFF, RevisionSource::SMC, ANY_REVISION, AMDGPU_FAMILY_CZ, ChipType::Stoney,
+        ChipVariant::Stoney, 0x61, 3, PowerTuneVariant::Tonga, "amde34a", "ativvaxy_stn", "AMD Radeon R Graphics"},
+    {0x98E4, 0x98E4, 0x00, 0xFF, RevisionSource::SMC, ANY_REVISION, AMDGPU_FAMILY_CZ, ChipType::Stoney,
+        ChipVariant::Stoney, 0x61, 2, PowerTuneVariant::Tonga, "amde34a", "ativvaxy_stn", "AMD Radeon R Graphics"},
+};
+
+//! `readRevision` is called at most once per revision source and must return the revision read from it.
+//! The revision read for the matching row is stored in `revision`.
+template<typename F>
+static const ASICDescriptor *findASIC(UInt16 deviceId, UInt8 pciRevision, F readRevision, UInt16 &revision) {
+    UInt16 revisions[3] {};
+    bool revisionRead[3] {};
+    for (auto &asic : asicTable) {
+        if (deviceId < asic.deviceIdLow || deviceId > asic.deviceIdHigh || pciRevision < asic.pciRevisionLow ||
+            pciRevision > asic.pciRevisionHigh) {
+            continue;
+        }
+
+        auto source = static_cast<size_t>(asic.revisionSource);
+        if (asic.revisionSource != RevisionSource::None && !revisionRead[source]) {
+            revisions[source] = readRevision(asic.revisionSource);
+            revisionRead[source] = true;
+        }
+        if (asic.revision != ANY_REVISION && asic.revision != revisions[source]) { continue; }
+
+        revision = revisions[source];
+        return &asic;
+    }
+    return nullptr;
+}
@@ -34,6 +34,42 @@ struct ATOMCommonTableHeader {
 constexpr UInt32 ATOM_ROM_TABLE_PTR = 0x48;
 constexpr UInt32 ATOM_ROM_DATA_PTR = 0x20;
 
+//! Master data table indices
+constexpr UInt32 ATOM_DATA_TABLE_FIRMWARE_INFO = 4;
+constexpr UInt32 ATOM_DATA_TABLE_OBJECT_HEADER = 22;
+constexpr UInt32 ATOM_DATA_TABLE_INTEGRATED_SYSTEM_INFO = 30;
+
+//! Common prefix of `ATOM_FIRMWARE_INFO` v1.x/v2.x and `atom_firmware_info_v3_x`
+struct ATOMFirmwareInfo : public ATOMCommonTableHeader {
+    UInt32 firmwareRevision;
+    UInt32 bootUpEngineClock;    //! In 10KHz
+    UInt32 bootUpMemoryClock;    //! In 10KHz
+} PACKED;
+
+//! Used by Kaveri/Kabini (1.8) and Carrizo/Stoney (1.9), the prefix we care about is identical
+struct IGPSystemInfoV1_8 : public ATOMCommonTableHeader {
+    UInt32 bootUpEngineClock;    //! In 10KHz
+    UInt32 dentistVCOFreq;
+    UInt32 bootUpUMAClock;    //! In 10KHz
+    UInt32 dispclkVoltage[8];
+    UInt32 bootUpReqDisplayVector;
+    UInt32 vbiosMisc;
+    UInt32 gpuCapInfo;
+    UInt32 dispClk2Freq;
+    UInt16 requestedPWMFreqInHz;
+    UInt8 htcTmpLmt;
+    UInt8 htcHystLmt;
+    UInt32 _reserved2;
+    UInt32 systemConfig;
+    UInt32 cpuCapInfo;
+    UInt32 _reserved3;
+    UInt16 gpuReservedSysMemSize;
+    UInt16 extDispConnInfoOffset;
+    UInt16 panelRefreshRateRange;
+    UInt8 memoryType;    //! [3:0] 1: DDR1, 2: DDR2, 3: DDR3, 4: DDR4, 5: GDDR5
+    UInt8 umaChannelNumber;
+} PACKED;
+
 struct IGPSystemInfoV11 : public ATOMCommonTableHeader {
     UInt32 vbiosMisc;
     UInt32 gpuCapInfo;
@@ -55,6 +91,7 @@ struct IGPSystemInfoV11 : public ATOMCommonTableHeader {
 } PACKED;
 
 enum DMIT17MemType : UInt8 {
+    kUnknownMemType = 0x02,
     kDDR2MemType = 0x13,
     kDDR2FBDIMMMemType,
     kDDR3MemType = 0x18,
@@ -80,6 +117,7 @@ struct IGPSystemInfoV2 : public ATOMCommonTableHeader {
 
 union IGPSystemInfo {
     ATOMCommonTableHeader header;
+    IGPSystemInfoV1_8 infoV1_8;
     IGPSystemInfoV11 infoV11;
     IGPSystemInfoV2 infoV2;
 };
@@ -0,0 +1,183 @@
+//! Copyright © 2024 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.5.
+//! See LICENSE for details.
+
+#include "AddressSpace.hpp"
+#include <Headers/kern_api.hpp>
+
+bool GPUAddressSpace::compute(UInt32 fbLocation, UInt32 fbOffsetReg, UInt32 memSizeMB, UInt64 gartSize) {
+    *this = {};
+
+    this->fbOffset = static_cast<UInt64>(fbOffsetReg) << 22;
+    this->vramSize = static_cast<UInt64>(memSizeMB) << 20;
+    this->vramStart = vramStartFromReadout(fbLocation);
+    this->vramEnd = this->vramStart + this->vramSize - 1;
+    this->gartSize = gartSize;
+    this->gartStart = APU_COMMON_GART_PADDR;
+    this->gartEnd = this->gartStart + this->gartSize - 1;
+
+    if (!this->vramSize) { this->errors |= kAddressSpaceNoVRAM; }
+    if ((this->vramStart | this->vramSize) & (MC_FB_LOCATION_ALIGN - 1)) {
+        this->errors |= kAddressSpaceVRAMMisaligned;
+    }
+    if (!this->gartSize || ((this->gartStart | this->gartSize) & (GART_ALIGN - 1))) {
+        this->errors |= kAddressSpaceGARTMisaligned;
+    }
+    if (this->vramEnd >= MC_ADDRESS_LIMIT || this->gartEnd >= MC_ADDRESS_LIMIT || this->vramEnd < this->vramStart ||
+        this->gartEnd < this->gartStart) {
+        this->errors |= kAddressSpaceOutOfRange;
+    }
+    if (this->vramStart <= this->gartEnd && this->gartStart <= this->vramEnd) {
+        this->errors |= kAddressSpaceOverlap;
+    }
+
+    SYSLOG_COND(this->errors, "AddrSpace", "Invalid layout (errors 0x%X)", this->errors);
+    DBGLOG("AddrSpace", "VRAM: 0x%llX-0x%llX (%lluMB), GART: 0x%llX-0x%llX (%lluMB), FB offset: 0x%llX",
+        this->vramStart, this->vramEnd, this->vramSize >> 20, this->gartStart, this->gartEnd, this->gartSize >> 20,
+        this->fbOffset);
+    return this->valid();
+}
+
+//! A quarter of the system memory, rounded down to a power of two.
+//! Big-memory systems stream more through the GART, small ones can't spare the page tables.
+UInt64 GPUAddressSpace::getAutoGARTSize(UInt64 physMemSize, UInt64 vramSize) {
+    if (physMemSize <= vramSize) { return 0; }
+    auto target = (physMemSize - vramSize) / 4;
+    if (target < GART_MIN_AUTO_SIZE) { return GART_MIN_AUTO_SIZE; }
+    if (target > GART_MAX_AUTO_SIZE) { return GART_MAX_AUTO_SIZE; }
+    return 1ULL << (63 - __builtin_clzll(target));
+}
+
+bool GPUAddressSpace::computeWithGARTPolicy(UInt32 fbLocation, UInt32 fbOffsetReg, UInt32 memSizeMB,
+    UInt64 physMemSize, UInt32 gartOverrideMB) {
+    const struct {
+        GARTSizeSource source;
+        UInt64 size;
+    } candidates[] = {
+        {GARTSizeSource::BootArg, static_cast<UInt64>(gartOverrideMB) << 20},
+        {GARTSizeSource::Auto, getAutoGARTSize(physMemSize, static_cast<UInt64>(memSizeMB) << 20)},
+        {GARTSizeSource::Default, CIK_DEFAULT_GART_SIZE},
+    };
+    for (auto &candidate : candidates) {
+        if (!candidate.size) { continue; }
+        if (this->compute(fbLocation, fbOffsetReg, memSizeMB, candidate.size)) {
+            this->gartSource = candidate.source;
+            return true;
+        }
+        SYSLOG("AddrSpace", "Rejected %lluMB GART (source %u)", candidate.size >> 20,
+            static_cast<UInt32>(candidate.source));
+    }
+    return false;
+}
+
+void GPUAddressSpace::computeFallback(UInt32 fbLocation, UInt32 fbOffsetReg, UInt32 memSizeMB) {
+    auto errors = this->errors;
+    *this = {};
+    this->fbOffset = static_cast<UInt64>(fbOffsetReg) << 22;
+    this->vramSize = static_cast<UInt64>(memSizeMB) << 20;
+    this->vramStart = vramStartFromReadout(fbLocation);
+    this->vramEnd = this->vramStart + this->vramSize - 1;
+    this->gartSize = CIK_DEFAULT_GART_SIZE;
+    this->gartStart = APU_COMMON_GART_PADDR;
+    this->gartEnd = this->gartStart + this->gartSize - 1;
+    this->gartSource = GARTSizeSource::Default;
+    this->errors = errors;
+    this->fallback = true;
+    SYSLOG("AddrSpace", "Using the fixed APU layout, VRAM: 0x%llX-0x%llX, GART: 0x%llX-0x%llX", this->vramStart,
+        this->vramEnd, this->gartStart, this->gartEnd);
+}
+
+void GPUAddressSpace::computeFromReadout(UInt32 fbLocation, UInt32 fbOffsetReg, UInt32 memSizeMB, UInt64 physMemSize,
+    UInt32 gartOverrideMB) {
+    if (!this->computeWithGARTPolicy(fbLocation, fbOffsetReg, memSizeMB, physMemSize, gartOverrideMB)) {
+        this->computeFallback(fbLocation, fbOffsetReg, memSizeMB);
+    }
+}
+
+#ifdef DEBUG
+//! Synthetic readouts as the VBIOS leaves them on each chip, plus the override and fallback paths
+bool GPUAddressSpace::selfTest() {
+    static const struct {
+        const char *name;
+        UInt32 fbLocation, fbOffsetReg, memSizeMB;
+        UInt64 physMemSize;
+        UInt32 gartOverrideMB;
+        UInt64 vramStart, vramEnd, gartSize;
+        GARTSizeSource gartSource;
+        UInt32 errors;
+        bool fallback;
+    } cases[] = {
+        {"Kaveri 1G/8G", 0xF43FF400, 0x3C0, 1024, 8ULL << 30, 0, 0xF400000000, 0xF43FFFFFFF, 1ULL << 30,
+            GARTSizeSource::Auto, 0, false},
+        {"Kalindi 512M/4G", 0xF41FF400, 0x3E0, 512, 4ULL << 30, 0, 0xF400000000, 0xF41FFFFFFF, 512ULL << 20,
+            GARTSizeSource::Auto, 0, false},
+        {"Carrizo 512M/16G", 0xF41FF400, 0x3E0, 512, 16ULL << 30, 0, 0xF400000000, 0xF41FFFFFFF, 2ULL << 30,
+            GARTSizeSource::Auto, 0, false},
+        {"Stoney 256M/2G", 0xF40FF400, 0x3F0, 256, 2ULL << 30, 0, 0xF400000000, 0xF40FFFFFFF, 256ULL << 20,
+            GARTSizeSource::Auto, 0, false},
+        //! Only the low byte of FB_BASE counts, as it always has
+        {"Stoney FB_BASE low byte", 0xF40FF401, 0x3F0, 256, 2ULL << 30, 0, 0xF401000000, 0xF410FFFFFF,
+            256ULL << 20, GARTSizeSource::Auto, 0, false},
+        {"Carrizo 3000M override", 0xF41FF400, 0x3E0, 512, 16ULL << 30, 3000, 0xF400000000, 0xF41FFFFFFF,
+            3000ULL << 20, GARTSizeSource::BootArg, 0, false},
+        //! Past the top of the MC address space, the auto size takes over
+        {"Carrizo 8G override", 0xF41FF400, 0x3E0, 512, 16ULL << 30, 8192, 0xF400000000, 0xF41FFFFFFF, 2ULL << 30,
+            GARTSizeSource::Auto, 0, false},
+        {"Kaveri no physical memory size", 0xF43FF400, 0x3C0, 1024, 0, 0, 0xF400000000, 0xF43FFFFFFF,
+            CIK_DEFAULT_GART_SIZE, GARTSizeSource::Default, 0, false},
+        {"Kalindi no CONFIG_MEMSIZE", 0xF41FF400, 0x3E0, 0, 4ULL << 30, 0, 0xF400000000, 0xF3FFFFFFFF,
+            CIK_DEFAULT_GART_SIZE, GARTSizeSource::Default, kAddressSpaceNoVRAM | kAddressSpaceOutOfRange, true},
+    };
+
+    bool passed = true;
+    for (auto &test : cases) {
+        GPUAddressSpace space {};
+        space.computeFromReadout(test.fbLocation, test.fbOffsetReg, test.memSizeMB, test.physMemSize,
+            test.gartOverrideMB);
+        if (space.vramStart == test.vramStart && space.vramEnd == test.vramEnd && space.gartSize == test.gartSize &&
+            space.gartStart == APU_COMMON_GART_PADDR && space.gartSource == test.gartSource &&
+            space.errors == test.errors && space.fallback == test.fallback &&
+            space.fbOffset == static_cast<UInt64>(test.fbOffsetReg) << 22) {
+            continue;
+        }
+        SYSLOG("AddrSpace", "Self-test \"%s\" failed: VRAM 0x%llX-0x%llX, GART %lluMB (source %u), errors 0x%X, "
+                            "fallback %d",
+            test.name, space.vramStart, space.vramEnd, space.gartSize >> 20, static_cast<UInt32>(space.gartSource),
+            space.errors, space.fallback);
+        passed = false;
+    }
+    return passed;
+}
+#endif
+
+void GPUAddressSpace::publish(IOService *service) const {
+    static const char *gartSourceNames[] = {"None", "Boot-arg", "Auto", "Default"};
+    const struct {
+        const char *name;
+        UInt64 value;
+    } numbers[] = {
+        {"FBOffset", this->fbOffset},
+        {"VRAMStart", this->vramStart},
+        {"VRAMEnd", this->vramEnd},
+        {"GARTStart", this->gartStart},
+        {"GARTEnd", this->gartEnd},
+        {"GARTSize", this->gartSize},
+        {"Errors", this->errors},
+    };
+
+    auto *dict = OSDictionary::withCapacity(arrsize(numbers) + 2);
+    if (!dict) { return; }
+    for (auto &entry : numbers) {
+        auto *num = OSNumber::withNumber(entry.value, 64);
+        if (!num) { continue; }
+        dict->setObject(entry.name, num);
+        num->release();
+    }
+    auto *source = OSString::withCString(gartSourceNames[static_cast<UInt32>(this->gartSource)]);
+    if (source) {
+        dict->setObject("GARTSizeSource", source);
+        source->release();
+    }
+    dict->setObject("Fallback", this->fallback ? kOSBooleanTrue : kOSBooleanFalse);
+    service->setProperty("LRed Address Space", dict);
+    dict->release();
+}
@@ -0,0 +1,81 @@
+//! Copyright © 2024 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.5.
+//! See LICENSE for details.
+
+#pragma once
+#include "AMDCommon.hpp"
+#include <Headers/kern_util.hpp>
+#include <IOKit/IOService.h>
+
+//! The MC address space is 40 bits wide on GFX 7/GFX 8
+constexpr UInt64 MC_ADDRESS_LIMIT = 1ULL << 40;
+//! `MC_VM_FB_LOCATION` is in 16M units
+constexpr UInt64 MC_FB_LOCATION_ALIGN = 1ULL << 24;
+constexpr UInt64 GART_ALIGN = 1ULL << 20;
+constexpr UInt64 GART_MIN_AUTO_SIZE = 256ULL << 20;
+//! Anything bigger doesn't fit below the top of the MC address space
+constexpr UInt64 GART_MAX_AUTO_SIZE = 4ULL << 30;
+
+enum struct GARTSizeSource : UInt32 {
+    None = 0,
+    BootArg,     //! `LRedGARTSize`, in MB
+    Auto,        //! Scaled to system memory
+    Default,     //! `CIK_DEFAULT_GART_SIZE`
+};
+
+enum AddressSpaceError : UInt32 {
+    kAddressSpaceNoVRAM = 1 << 0,
+    kAddressSpaceVRAMMisaligned = 1 << 1,
+    kAddressSpaceGARTMisaligned = 1 << 2,
+    kAddressSpaceOutOfRange = 1 << 3,
+    kAddressSpaceOverlap = 1 << 4,
+};
+
+//! Where everything lives in the GPU's MC address space, computed once from the register readouts.
+//! All ranges are inclusive.
+struct GPUAddressSpace {
+    UInt64 fbOffset {0};    //! Physical address of the stolen memory
+    UInt64 vramSize {0};
+    UInt64 vramStart {0};
+    UInt64 vramEnd {0};
+    UInt64 gartSize {0};
+    UInt64 gartStart {0};
+    UInt64 gartEnd {0};
+    GARTSizeSource gartSource {GARTSizeSource::None};
+    UInt32 errors {0};
+    bool fallback {false};    //! No layout was valid, these are the fixed values used before the layout was computed
+
+    //! `fbLocation`, `fbOffset` and `memSizeMB` are the raw `MC_VM_FB_LOCATION`, `MC_VM_FB_OFFSET` and
+    //! `CONFIG_MEMSIZE` values
+    bool compute(UInt32 fbLocation, UInt32 fbOffsetReg, UInt32 memSizeMB, UInt64 gartSize);
+    //! Same as `compute`, but picks the GART size: the override if given, else one scaled to the system memory
+    //! left after the carve-out, else the default; the first one giving a valid layout wins
+    bool computeWithGARTPolicy(UInt32 fbLocation, UInt32 fbOffsetReg, UInt32 memSizeMB, UInt64 physMemSize,
+        UInt32 gartOverrideMB);
+    //! The fixed APU layout, for when no computed layout is valid. `errors` is kept from the failed attempts.
+    void computeFallback(UInt32 fbLocation, UInt32 fbOffsetReg, UInt32 memSizeMB);
+    //! `computeWithGARTPolicy`, falling back to `computeFallback`
+    void computeFromReadout(UInt32 fbLocation, UInt32 fbOffsetReg, UInt32 memSizeMB, UInt64 physMemSize,
+        UInt32 gartOverrideMB);
+    static UInt64 getAutoGARTSize(UInt64 physMemSize, UInt64 vramSize);
+    //! Where VRAM starts for an `MC_VM_FB_LOCATION` readout. The shift is done in 32 bits, which only keeps the low
+    //! byte of FB_BASE, as the original readout always did; the system aperture is programmed from this.
+    static UInt64 vramStartFromReadout(UInt32 fbLocation) {
+        return APU_COMMON_VRAM_PADDR + static_cast<UInt32>(fbLocation << 24);
+    }
+#ifdef DEBUG
+    //! Runs `computeFromReadout` over synthetic per-chip readouts, logging every mismatch
+    static bool selfTest();
+#endif
+    void publish(IOService *service) const;
+
+    bool valid() const { return !this->errors; }
+
+    //! Register values of the system aperture, in 4K pages
+    UInt32 systemApertureLow() const { return static_cast<UInt32>(this->vramStart >> 12); }
+    UInt32 systemApertureHigh() const { return static_cast<UInt32>(this->vramEnd >> 12); }
+
+    //! The AGP aperture is unused, BOT above TOP disables it
+    static constexpr UInt32 agpBase() { return 0; }
+    static constexpr UInt32 agpTop() { return 0; }
+    static constexpr UInt32 agpBot() { return static_cast<UInt32>(AGP_DISABLE_ADDR); }
+};
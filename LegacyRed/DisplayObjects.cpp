@@ -0,0 +1,190 @@
+//! Copyright © 2024 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.5.
+//! See LICENSE for details.
+
+#include "DisplayObjects.hpp"
+#include <Headers/kern_api.hpp>
+
+static const ATOMObjTable *getObjTable(const UInt8 *vbios, size_t vbiosSize, size_t offset) {
+    if (offset + sizeof(ATOMObjTable) > vbiosSize) { return nullptr; }
+    const auto *table = reinterpret_cast<const ATOMObjTable *>(vbios + offset);
+    if (offset + sizeof(ATOMObjTable) + table->numberOfObjects * sizeof(ATOMObj) > vbiosSize) { return nullptr; }
+    return table;
+}
+
+//! First source object of an `ATOMSrcDstTable`, which isn't naturally aligned.
+static UInt16 getFirstSrcObjectId(const UInt8 *vbios, size_t vbiosSize, size_t offset) {
+    if (offset + 3 > vbiosSize || !vbios[offset]) { return 0; }
+    return static_cast<UInt16>(vbios[offset + 1] | (vbios[offset + 2] << 8));
+}
+
+bool DisplayObjectGraph::parse(const UInt8 *vbios, size_t vbiosSize, size_t objHeaderOffset) {
+    *this = {};
+
+    if (objHeaderOffset + sizeof(ATOMObjHeader) > vbiosSize) {
+        DBGLOG("DispObj", "Object header out of bounds");
+        return false;
+    }
+    const auto *header = reinterpret_cast<const ATOMObjHeader *>(vbios + objHeaderOffset);
+    this->deviceSupport = header->deviceSupport;
+
+    const auto *connectors = getObjTable(vbios, vbiosSize, objHeaderOffset + header->connectorObjectTableOffset);
+    if (!connectors) {
+        DBGLOG("DispObj", "Connector object table out of bounds");
+        return false;
+    }
+    this->rawConnectorCount = connectors->numberOfObjects;
+    for (size_t i = 0; i < connectors->numberOfObjects; i++) {
+        const auto &obj = connectors->objects[i];
+        auto type = getObjectType(obj.objectID);
+        if (type != GRAPH_OBJECT_TYPE_CONNECTOR) {
+            SYSLOG("DispObj", "Invalid Connector Info Table entry at index 0x%zx, with object type 0x%x", i, type);
+            continue;
+        }
+        if (this->connectorCount == MAX_DISPLAY_OBJECTS) {
+            SYSLOG("DispObj", "Too many connectors, ignoring the rest");
+            this->truncated = true;
+            break;
+        }
+        auto n = this->connectorCount++;
+        this->connectorIds[n] = obj.objectID;
+        this->connectorSrcDstOffsets[n] = obj.srcDstTableOffset;
+        this->connectorRecordOffsets[n] = obj.recordOffset;
+        this->connectorSrcEncoderIds[n] =
+            obj.srcDstTableOffset ? getFirstSrcObjectId(vbios, vbiosSize, objHeaderOffset + obj.srcDstTableOffset) : 0;
+    }
+
+    const auto *encoders = header->encoderObjectTableOffset ?
+                               getObjTable(vbios, vbiosSize, objHeaderOffset + header->encoderObjectTableOffset) :
+                               nullptr;
+    if (encoders) {
+        for (size_t i = 0; i < encoders->numberOfObjects; i++) {
+            const auto &obj = encoders->objects[i];
+            if (getObjectType(obj.objectID) != GRAPH_OBJECT_TYPE_ENCODER) { continue; }
+            if (this->encoderCount == MAX_DISPLAY_OBJECTS) {
+                SYSLOG("DispObj", "Too many encoders, ignoring the rest");
+                this->truncated = true;
+                break;
+            }
+            auto n = this->encoderCount++;
+            this->encoderIds[n] = obj.objectID;
+            this->encoderRecordOffsets[n] = obj.recordOffset;
+        }
+    }
+
+    size_t pathOffset = objHeaderOffset + header->displayPathTableOffset;
+    if (header->displayPathTableOffset && pathOffset + sizeof(ATOMDispObjPathTable) <= vbiosSize) {
+        const auto *paths = reinterpret_cast<const ATOMDispObjPathTable *>(vbios + pathOffset);
+        pathOffset += sizeof(ATOMDispObjPathTable);
+        for (size_t i = 0; i < paths->numOfDispPath; i++) {
+            if (this->pathCount == MAX_DISPLAY_OBJECTS) {
+                SYSLOG("DispObj", "Too many display paths, ignoring the rest");
+                this->truncated = true;
+                break;
+            }
+            if (pathOffset + sizeof(ATOMDispObjPath) > vbiosSize) { break; }
+            const auto *path = reinterpret_cast<const ATOMDispObjPath *>(vbios + pathOffset);
+            if (path->size < sizeof(ATOMDispObjPath) || pathOffset + path->size > vbiosSize) {
+                DBGLOG("DispObj", "Display path %zu is malformed", i);
+                break;
+            }
+            pathOffset += path->size;
+
+            auto n = this->pathCount++;
+            this->pathDeviceTags[n] = path->deviceTag;
+            this->pathConnectorIds[n] = path->connObjectId;
+            this->pathConnectorIndices[n] = this->findConnector(path->connObjectId);
+            this->pathEncoderIndices[n] = DISPLAY_OBJECT_INDEX_NONE;
+            auto graphicObjCount = (path->size - sizeof(ATOMDispObjPath)) / sizeof(UInt16);
+            for (size_t j = 0; j < graphicObjCount; j++) {
+                auto objId = path->graphicObjIds[j];
+                if (getObjectType(objId) != GRAPH_OBJECT_TYPE_ENCODER) { continue; }
+                if (!this->pathEncoderIds[n]) {
+                    this->pathEncoderIds[n] = objId;
+                    this->pathEncoderIndices[n] = this->findEncoder(objId);
+                } else if (!this->pathExtEncoderIds[n]) {
+                    this->pathExtEncoderIds[n] = objId;
+                }
+            }
+        }
+    }
+
+    DBGLOG("DispObj", "Parsed %u connectors (%u in table), %u encoders, %u paths", this->connectorCount,
+        this->rawConnectorCount, this->encoderCount, this->pathCount);
+    this->valid = true;
+    return true;
+}
+
+//! Whether `table` holds exactly the connectors we parsed, in the same order, with the non-connector entries
+//! in between. Only then can the cached graph stand in for filtering the table.
+bool DisplayObjectGraph::matchesConnectorTable(const ATOMObjTable *table) const {
+    if (!this->valid || this->truncated || table->numberOfObjects != this->rawConnectorCount) { return false; }
+    size_t n = 0;
+    for (size_t i = 0; i < table->numberOfObjects; i++) {
+        const auto &obj = table->objects[i];
+        if (getObjectType(obj.objectID) != GRAPH_OBJECT_TYPE_CONNECTOR) { continue; }
+        if (n == this->connectorCount || obj.objectID != this->connectorIds[n] ||
+            obj.srcDstTableOffset != this->connectorSrcDstOffsets[n] ||
+            obj.recordOffset != this->connectorRecordOffsets[n]) {
+            return false;
+        }
+        n++;
+    }
+    return n == this->connectorCount;
+}
+
+static OSArray *makeNumberArray(const UInt16 *values, size_t count) {
+    auto *array = OSArray::withCapacity(static_cast<unsigned int>(count));
+    if (!array) { return nullptr; }
+    for (size_t i = 0; i < count; i++) {
+        auto *num = OSNumber::withNumber(values[i], 16);
+        if (!num) { continue; }
+        array->setObject(num);
+        num->release();
+    }
+    return array;
+}
+
+void DisplayObjectGraph::publish(IOService *service) const {
+    if (!this->valid) { return; }
+
+    auto *dict = OSDictionary::withCapacity(10);
+    if (!dict) {
+        DBGLOG("DispObj", "Failed to create dictionary");
+        return;
+    }
+
+    const struct {
+        const char *name;
+        const UInt16 *values;
+        size_t count;
+    } arrays[] = {
+        {"ConnectorIDs", this->connectorIds, this->connectorCount},
+        {"ConnectorSourceEncoderIDs", this->connectorSrcEncoderIds, this->connectorCount},
+        {"EncoderIDs", this->encoderIds, this->encoderCount},
+        {"PathDeviceTags", this->pathDeviceTags, this->pathCount},
+        {"PathConnectorIDs", this->pathConnectorIds, this->pathCount},
+        {"PathEncoderIDs", this->pathEncoderIds, this->pathCount},
+        {"PathExtEncoderIDs", this->pathExtEncoderIds, this->pathCount},
+    };
+    for (auto &entry : arrays) {
+        auto *array = makeNumberArray(entry.values, entry.count);
+        if (!array) { continue; }
+        dict->setObject(entry.name, array);
+        array->release();
+    }
+
+    auto *num = OSNumber::withNumber(this->deviceSupport, 16);
+    if (num) {
+        dict->setObject("DeviceSupport", num);
+        num->release();
+    }
+    num = OSNumber::withNumber(this->rawConnectorCount, 8);
+    if (num) {
+        dict->setObject("RawConnectorCount", num);
+        num->release();
+    }
+    dict->setObject("Truncated", this->truncated ? kOSBooleanTrue : kOSBooleanFalse);
+
+    service->setProperty("LRed Display Objects", dict);
+    dict->release();
+}
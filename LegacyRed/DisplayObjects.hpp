@@ -0,0 +1,59 @@
+//! Copyright © 2024 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.5.
+//! See LICENSE for details.
+
+#pragma once
+#include "ATOMBIOS.hpp"
+#include <Headers/kern_util.hpp>
+#include <IOKit/IOService.h>
+
+constexpr size_t MAX_DISPLAY_OBJECTS = 16;
+constexpr UInt8 DISPLAY_OBJECT_INDEX_NONE = 0xFF;
+
+//! The VBIOS display object graph, parsed once at VBIOS load.
+//! Kept as a structure of arrays so lookups on the hot path only touch the IDs they compare against.
+struct DisplayObjectGraph {
+    bool valid {false};
+    UInt16 deviceSupport {0};
+    //! Number of entries in the VBIOS connector table, including the non-connector ones we drop.
+    UInt8 rawConnectorCount {0};
+    //! Set when a table had more than `MAX_DISPLAY_OBJECTS` entries of a kind, the rest weren't parsed.
+    bool truncated {false};
+
+    UInt8 connectorCount {0};
+    UInt16 connectorIds[MAX_DISPLAY_OBJECTS] {};
+    UInt16 connectorSrcDstOffsets[MAX_DISPLAY_OBJECTS] {};
+    UInt16 connectorRecordOffsets[MAX_DISPLAY_OBJECTS] {};
+    UInt16 connectorSrcEncoderIds[MAX_DISPLAY_OBJECTS] {};
+
+    UInt8 encoderCount {0};
+    UInt16 encoderIds[MAX_DISPLAY_OBJECTS] {};
+    UInt16 encoderRecordOffsets[MAX_DISPLAY_OBJECTS] {};
+
+    UInt8 pathCount {0};
+    UInt16 pathDeviceTags[MAX_DISPLAY_OBJECTS] {};
+    UInt16 pathConnectorIds[MAX_DISPLAY_OBJECTS] {};
+    UInt16 pathEncoderIds[MAX_DISPLAY_OBJECTS] {};
+    UInt16 pathExtEncoderIds[MAX_DISPLAY_OBJECTS] {};
+    UInt8 pathConnectorIndices[MAX_DISPLAY_OBJECTS] {};
+    UInt8 pathEncoderIndices[MAX_DISPLAY_OBJECTS] {};
+
+    bool parse(const UInt8 *vbios, size_t vbiosSize, size_t objHeaderOffset);
+    void publish(IOService *service) const;
+    bool matchesConnectorTable(const ATOMObjTable *table) const;
+
+    UInt8 findConnector(UInt16 objectId) const {
+        for (UInt8 i = 0; i < this->connectorCount; i++) {
+            if (this->connectorIds[i] == objectId) { return i; }
+        }
+        return DISPLAY_OBJECT_INDEX_NONE;
+    }
+
+    UInt8 findEncoder(UInt16 objectId) const {
+        for (UInt8 i = 0; i < this->encoderCount; i++) {
+            if (this->encoderIds[i] == objectId) { return i; }
+        }
+        return DISPLAY_OBJECT_INDEX_NONE;
+    }
+
+    static UInt8 getObjectType(UInt16 objectId) { return (objectId & OBJECT_TYPE_MASK) >> OBJECT_TYPE_SHIFT; }
+};
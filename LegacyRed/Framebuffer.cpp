@@ -6,6 +6,7 @@
 #include "PatcherPlus.hpp"
 #include <Headers/kern_api.hpp>
 #include <Headers/kern_util.hpp>
+#include <kern/clock.h>
 
 static const char *pathAMDFramebuffer = "/System/Library/Extensions/AMDFramebuffer.kext/Contents/MacOS/AMDFramebuffer";
 
@@ -16,12 +17,6 @@ Framebuffer *Framebuffer::callback = nullptr;
 
 void Framebuffer::init() {
     callback = this;
-    this->fbPtrs[0] = nullptr;
-    this->fbPtrs[1] = nullptr;
-    this->fbPtrs[2] = nullptr;
-    this->fbPtrs[3] = nullptr;
-    this->fbPtrs[4] = nullptr;
-    this->fbPtrs[5] = nullptr;
     lilu.onKextLoadForce(&kextAMDFramebuffer);
 }
 
@@ -43,49 +38,145 @@ bool Framebuffer::processKext(KernelPatcher &patcher, size_t index, mach_vm_addr
         };
         PANIC_COND(!RouteRequestPlus::routeAll(patcher, index, requests, address, size), "Framebuffer",
             "Failed to route populateDisplayModeInformation!");
+
+        //! Without it, stopped framebuffers stay registered until a new one reuses the slot
+        RouteRequestPlus stopRequest {"__ZN14AMDFramebuffer4stopEP9IOService", wrapStop, this->orgStop};
+        SYSLOG_COND(!stopRequest.route(patcher, index, address, size), "Framebuffer", "Failed to route stop");
+
+        this->slotsLock = IOLockAlloc();
+        PANIC_COND(!this->slotsLock, "Framebuffer", "Failed to allocate slots lock");
+
+        this->dumpCall = thread_call_allocate(dumpTimer, this);
+        SYSLOG_COND(!this->dumpCall, "Framebuffer", "Failed to allocate dump thread call");
+        clock_interval_to_absolutetime_interval(FB_DUMP_DEBOUNCE_MS, kMillisecondScale, &this->dumpDebounce);
         return true;
     }
     return false;
 }
 
+bool Framebuffer::registerFramebuffer(void *fb, IOService *provider) {
+    IOLockLock(this->slotsLock);
+    for (UInt32 i = 0; i < MAX_FRAMEBUFFER_COUNT; i++) {
+        auto &slot = this->fbSlots[i];
+        if (slot.state != kFramebufferSlotFree) { continue; }
+        slot.fb = fb;
+        slot.provider = provider;
+        slot.startTime = mach_absolute_time();
+        slot.state = kFramebufferSlotLive;
+        IOLockUnlock(this->slotsLock);
+        DBGLOG("Framebuffer", "Registered <%p> as framebuffer %u", fb, i);
+        this->signalDump();
+        return true;
+    }
+    IOLockUnlock(this->slotsLock);
+    SYSLOG("Framebuffer", "No free slot for framebuffer <%p>", fb);
+    return false;
+}
+
+//! Doesn't wait for readers, they hold a retain on the framebuffer rather than the slot.
+void Framebuffer::unregisterFramebuffer(void *fb) {
+    IOLockLock(this->slotsLock);
+    for (UInt32 i = 0; i < MAX_FRAMEBUFFER_COUNT; i++) {
+        auto &slot = this->fbSlots[i];
+        if (slot.state != kFramebufferSlotLive || slot.fb != fb) { continue; }
+        slot.fb = nullptr;
+        slot.provider = nullptr;
+        slot.state = kFramebufferSlotFree;
+        IOLockUnlock(this->slotsLock);
+        DBGLOG("Framebuffer", "Unregistered <%p> from framebuffer %u", fb, i);
+        this->signalDump();
+        return;
+    }
+    IOLockUnlock(this->slotsLock);
+}
+
+bool Framebuffer::isRegistered(UInt32 index, void *fb) {
+    IOLockLock(this->slotsLock);
+    auto &slot = this->fbSlots[index];
+    bool ret = slot.state == kFramebufferSlotLive && slot.fb == fb;
+    IOLockUnlock(this->slotsLock);
+    return ret;
+}
+
+void Framebuffer::signalDump(UInt32 flags) {
+    OSBitOrAtomic(flags, &this->dumpDirty);
+    //! Not re-armed while pending, so a storm of requests can't keep pushing the dump back
+    if (!this->dumpCall || !OSCompareAndSwap(0, 1, &this->dumpScheduled)) { return; }
+    thread_call_enter_delayed(this->dumpCall, mach_absolute_time() + this->dumpDebounce);
+}
+
+void Framebuffer::dumpTimer(thread_call_param_t param0, thread_call_param_t) {
+    auto *that = static_cast<Framebuffer *>(param0);
+    //! `dumpScheduled` stays set until the dump is done, so dumps never overlap and race on the hashes.
+    //! Requests made meanwhile only mark themselves dirty, and are picked up by re-arming below.
+    auto dirty = OSBitAndAtomic(0, &that->dumpDirty);
+    if (dirty & kFramebufferDumpProps) { that->dumpAllFramebuffers(); }
+    if (dirty & kFramebufferDumpDevProps) { that->fbDumpDevProps(); }
+    that->dumpScheduled = 0;
+    OSMemoryBarrier();
+    if (that->dumpDirty && OSCompareAndSwap(0, 1, &that->dumpScheduled)) {
+        thread_call_enter_delayed(that->dumpCall, mach_absolute_time() + that->dumpDebounce);
+    }
+}
+
+//! Compares an FNV-1a hash of the serialised dictionary against the last published one,
+//! so repeated dumps of unchanged data don't touch the IORegistry.
+bool Framebuffer::publishIfChanged(const char *name, OSDictionary *dict, UInt64 &lastHash) {
+    auto *serialized = OSSerialize::withCapacity(4096);
+    if (serialized && dict->serialize(serialized)) {
+        UInt64 hash = 0xCBF29CE484222325;
+        const auto *text = serialized->text();
+        for (UInt32 i = 0; i < serialized->getLength(); i++) {
+            hash ^= static_cast<UInt8>(text[i]);
+            hash *= 0x100000001B3;
+        }
+        if (hash == lastHash) {
+            serialized->release();
+            return false;
+        }
+        lastHash = hash;
+    }
+    OSSafeReleaseNULL(serialized);
+    LRed::callback->iGPU->setProperty(name, dict);
+    return true;
+}
+
 IOReturn Framebuffer::dumpAllFramebuffers() {
-    OSDictionary *upperDict = OSDictionary::withCapacity(6);
+    OSDictionary *upperDict = OSDictionary::withCapacity(MAX_FRAMEBUFFER_COUNT);
     if (upperDict == nullptr) {
         DBGLOG("Framebuffer", "Failed to create dictionary");
         return kIOReturnNoMemory;
-    } else if (fbPtrs[0] == nullptr) {
-        OSSafeReleaseNULL(upperDict);
-        DBGLOG("Framebuffer", "Cannot dump at this time, FB 0 pointer is null.");
-        return kIOReturnNoDevice;
     }
-    for (int i = 0; i < MAX_FRAMEBUFFER_COUNT; i++) {
-        if (callback->fbPtrs[i] == nullptr) {
-            break;
-        } else {
-            OSDictionary *dict = OSDictionary::withCapacity(1);
-            if (dict == nullptr) {
-                DBGLOG("Framebuffer", "Failed to create dictionary");
-                OSSafeReleaseNULL(upperDict);
-                return kIOReturnNoMemory;
-            }
-            callback->orgGetPropsForUC(callback->fbPtrs[i], dict);
-            char name[128];
-            snprintf(name, 128, "Framebuffer %d", i);
-            upperDict->setObject(name, dict);
-            OSSafeReleaseNULL(dict);
+    bool failed = false;
+    UInt32 count = 0;
+    this->forEachFramebuffer([&](UInt32 i, const FramebufferSlot &slot) {
+        count++;
+        OSDictionary *dict = OSDictionary::withCapacity(1);
+        if (dict == nullptr) {
+            failed = true;
+            return;
         }
+        callback->orgGetPropsForUC(slot.fb, dict);
+        char name[128];
+        snprintf(name, 128, "Framebuffer %u", i);
+        upperDict->setObject(name, dict);
+        OSSafeReleaseNULL(dict);
+    });
+    if (failed) {
+        DBGLOG("Framebuffer", "Failed to create dictionary");
+        OSSafeReleaseNULL(upperDict);
+        return kIOReturnNoMemory;
+    } else if (count == 0) {
+        OSSafeReleaseNULL(upperDict);
+        DBGLOG("Framebuffer", "Cannot dump at this time, no framebuffer is registered.");
+        return kIOReturnNoDevice;
     }
-    LRed::callback->iGPU->setProperty("iGPU Framebuffer Config", upperDict);
+    this->publishIfChanged("iGPU Framebuffer Config", upperDict, this->propsHash);
     OSSafeReleaseNULL(upperDict);
     return kIOReturnSuccess;
 }
 
 IOReturn Framebuffer::fbDumpDevProps() {
-    if (this->fbPtrs[0] == nullptr) {
-        DBGLOG("Framebuffer", "Cannot dump at this time, FB 0 pointer is null.");
-        return kIOReturnNoDevice;
-    }
-
     OSDictionary *dict = OSDictionary::withCapacity(1);
     if (dict == nullptr) {
         DBGLOG("Framebuffer", "Failed to create dictionary");
@@ -93,9 +184,19 @@ IOReturn Framebuffer::fbDumpDevProps() {
     }
 
     //! funnily enough theres one where we can dump the FB itself
-    callback->orgGetDevPropsForUC(callback->fbPtrs[0], dict);    //! attrocity #1
+    bool dumped = false;
+    this->forEachFramebuffer([&](UInt32, const FramebufferSlot &slot) {
+        if (dumped) { return; }
+        callback->orgGetDevPropsForUC(slot.fb, dict);    //! attrocity #1
+        dumped = true;
+    });
+    if (!dumped) {
+        DBGLOG("Framebuffer", "Cannot dump at this time, no framebuffer is registered.");
+        OSSafeReleaseNULL(dict);
+        return kIOReturnNoDevice;
+    }
 
-    LRed::callback->iGPU->setProperty("iGPU Device Config", dict);
+    this->publishIfChanged("iGPU Device Config", dict, this->devPropsHash);
     OSSafeReleaseNULL(dict);
 
     return kIOReturnSuccess;
@@ -133,10 +234,13 @@ IOReturn Framebuffer::wrapPopulateDisplayModeInfo(void *that, void *detailedTimi
 
 bool Framebuffer::wrapStart(void *that, void *provider) {
     DBGLOG("FB", "<%p>::start(%p)", that, provider);
-    for (int i = 0; i < MAX_FRAMEBUFFER_COUNT; i++) {
-        if (callback->fbPtrs[i] == nullptr) {
-            callback->fbPtrs[i] = that;
-        }
-    }
-    return FunctionCast(wrapStart, callback->orgStart)(that, provider);
+    bool ret = FunctionCast(wrapStart, callback->orgStart)(that, provider);
+    if (ret) { callback->registerFramebuffer(that, static_cast<IOService *>(provider)); }
+    return ret;
+}
+
+void Framebuffer::wrapStop(void *that, void *provider) {
+    DBGLOG("FB", "<%p>::stop(%p)", that, provider);
+    callback->unregisterFramebuffer(that);
+    FunctionCast(wrapStop, callback->orgStop)(that, provider);
 }
@@ -4,10 +4,36 @@
 #pragma once
 #include "AMDCommon.hpp"
 #include <Headers/kern_patcher.hpp>
+#include <IOKit/IOLib.h>
+#include <kern/thread_call.h>
+#include <libkern/OSAtomic.h>
 
 using t_getPropsForUserClient = void (*)(void *fb, OSDictionary *dict);
 
 constexpr UInt32 MAX_FRAMEBUFFER_COUNT = 6;
+//! Dump requests within this window of the first one are coalesced into a single dump
+constexpr UInt32 FB_DUMP_DEBOUNCE_MS = 250;
+
+enum FramebufferDumpFlags : UInt32 {
+    kFramebufferDumpProps = 1 << 0,       //! "iGPU Framebuffer Config"
+    kFramebufferDumpDevProps = 1 << 1,    //! "iGPU Device Config"
+    kFramebufferDumpAll = kFramebufferDumpProps | kFramebufferDumpDevProps,
+};
+
+enum FramebufferSlotState : UInt32 {
+    kFramebufferSlotFree = 0,
+    kFramebufferSlotLive,
+};
+
+//! A started `AMDFramebuffer`, guarded by `Framebuffer::slotsLock`.
+//! Readers retain the framebuffer instead of holding the slot, so `stop` never waits on them; a reader may still be
+//! mid-call when `stop` runs, which is no different from a user client racing it.
+struct FramebufferSlot {
+    UInt32 state;
+    void *fb;
+    IOService *provider;
+    UInt64 startTime;
+};
 
 class Framebuffer {
     public:
@@ -16,17 +42,58 @@ class Framebuffer {
     bool processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size);
     IOReturn fbDumpDevProps();
     IOReturn dumpAllFramebuffers();
+    //! Marks the given dumps dirty; they're done on a thread call once the debounce window elapses
+    void signalDump(UInt32 flags = kFramebufferDumpAll);
 
     private:
     mach_vm_address_t orgPopulateDisplayModeInfo {0};
     mach_vm_address_t orgStart {0};
+    mach_vm_address_t orgStop {0};
     t_getPropsForUserClient orgGetDevPropsForUC {0};
     t_getPropsForUserClient orgGetPropsForUC {0};
 
     static IOReturn wrapPopulateDisplayModeInfo(void *that, void *detailedTiming, void *param2, void *param3,
         void *param4, void *modeInfo);
     static bool wrapStart(void *that, void *provider);
+    static void wrapStop(void *that, void *provider);
+
+    static void dumpTimer(thread_call_param_t param0, thread_call_param_t param1);
+    bool publishIfChanged(const char *name, OSDictionary *dict, UInt64 &lastHash);
+
+    bool registerFramebuffer(void *fb, IOService *provider);
+    void unregisterFramebuffer(void *fb);
+
+    bool isRegistered(UInt32 index, void *fb);
+
+    //! Calls `func(index, slot)` for each live framebuffer on a copy of its slot, with the framebuffer retained.
+    //! Framebuffers that have begun stopping by the time their turn comes are skipped.
+    template<typename F>
+    void forEachFramebuffer(F func) {
+        FramebufferSlot live[MAX_FRAMEBUFFER_COUNT];
+        UInt32 indices[MAX_FRAMEBUFFER_COUNT];
+        UInt32 count = 0;
+        IOLockLock(this->slotsLock);
+        for (UInt32 i = 0; i < MAX_FRAMEBUFFER_COUNT; i++) {
+            if (this->fbSlots[i].state != kFramebufferSlotLive) { continue; }
+            static_cast<OSObject *>(this->fbSlots[i].fb)->retain();
+            live[count] = this->fbSlots[i];
+            indices[count++] = i;
+        }
+        IOLockUnlock(this->slotsLock);
+        for (UInt32 i = 0; i < count; i++) {
+            if (this->isRegistered(indices[i], live[i].fb)) { func(indices[i], live[i]); }
+            static_cast<OSObject *>(live[i].fb)->release();
+        }
+    }
 
     UInt32 bitsPerComponent {0};
-    void *fbPtrs[6];
+    IOLock *slotsLock {nullptr};
+    FramebufferSlot fbSlots[MAX_FRAMEBUFFER_COUNT] {};
+
+    thread_call_t dumpCall {nullptr};
+    uint64_t dumpDebounce {0};
+    volatile UInt32 dumpDirty {0};
+    volatile UInt32 dumpScheduled {0};
+    UInt64 propsHash {0};
+    UInt64 devPropsHash {0};
 };
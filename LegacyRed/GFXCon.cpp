@@ -4,6 +4,7 @@
 #include "GFXCon.hpp"
 #include "LRed.hpp"
 #include "PatcherPlus.hpp"
+#include "RegBatch.hpp"
 #include "Support.hpp"
 #include <Headers/kern_api.hpp>
 
@@ -47,10 +48,11 @@ bool GFXCon::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t
         return true;
     } else if (kextAMD9KController.loadIndex == index) {
         LRed::callback->setRMMIOIfNecessary();
+        this->ihStats.init(LRed::callback->iGPU);
+        PE_parse_boot_argn("LRedIHMode", &this->ihMode, sizeof(this->ihMode));
+        this->IHAllocWptrSlot();
 
         SolveRequestPlus solveRequests[] = {
-            {"__ZN18VIInterruptManager16setRBReadPointerEj", this->IHSetRBReadPointer},
-            {"__ZN18VIInterruptManager22getWPTRWriteBackOffsetEv", this->IHGetWPTRWriteBackOffset},
             {"__ZN18VIInterruptManager24isUsingVRAMForRingBufferEv", this->IHIsUsingVRAMForRingBuffer},
             {"__ZN18VIInterruptManager31getActiveRingBufferSizeRegValueEv", this->IHGetActiveRingBufferSizeRegValue},
         };
@@ -61,6 +63,7 @@ bool GFXCon::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t
             {"__ZNK18VISharedController11getFamilyIdEv", wrapGetFamilyId, this->orgGetFamilyId},
             {"__ZN13ASIC_INFO__VI18populateDeviceInfoEv", wrapPopulateDeviceInfo, this->orgPopulateDeviceInfo},
             {"__ZN18VIInterruptManager18setHardwareEnabledEb", IHSetHardwareEnabled},
+            {"__ZN18VIInterruptManager16setRBReadPointerEj", wrapIHSetRBReadPointer, this->IHSetRBReadPointer},
         };
         PANIC_COND(!RouteRequestPlus::routeAll(patcher, index, requests, address, size), "GFXCon",
             "Failed to route symbols");
@@ -89,7 +92,7 @@ IOReturn GFXCon::wrapPopulateDeviceInfo(void *that) {
     return ret;
 }
 
-//-------- Carrizo IH fixes !!! WIP DO NOT USE YET !!! --------//
+//-------- Carrizo IH --------//
 
 enum InterruptManagerFields {
     Unk1 = 0x32,
@@ -106,6 +109,109 @@ enum InterruptManagerFlags {
     IHEnableClockGating = 0x10,    //! unused in VIIntMgr
 };
 
+bool GFXCon::isMSIEnabled() {
+    UInt8 offset = 0;
+    if (!LRed::callback->iGPU->findPCICapability(kIOPCICapabilityIDMSI, &offset) || !offset) { return false; }
+    //! Bit 0 of the MSI Message Control register
+    return LRed::callback->iGPU->configRead16(offset + 2) & 1;
+}
+
+//! Applies the `LRedIHMode` policy to the interrupt manager's flags, which `IHProgramRing` then follows.
+//! Whether MSI is used is decided when the interrupt is registered, so only a matching request can be honoured.
+void GFXCon::IHApplyMode(void *ihmgr) {
+    auto &flags = getMember<UInt32>(ihmgr, InterruptManagerFields::Flags);
+    if (callback->ihMode != IH_MODE_UNSET) {
+        bool level = callback->ihMode & IH_MODE_LEVEL;
+        bool msi = callback->ihMode & IH_MODE_MSI;
+        if (msi != isMSIEnabled()) {
+            SYSLOG("GFXCon", "CZ IH: %s requested but the device uses %s, ignoring", msi ? "MSI" : "legacy INTx",
+                msi ? "legacy INTx" : "MSI");
+            msi = !msi;
+        }
+        flags = level ? (flags | InterruptManagerFlags::DontUsePulseBasedInterrupts) :
+                        (flags & ~InterruptManagerFlags::DontUsePulseBasedInterrupts);
+        flags = msi ? (flags | InterruptManagerFlags::MSIEnabled) : (flags & ~InterruptManagerFlags::MSIEnabled);
+        Support::callback->IHInitPulseBasedInterrupts(ihmgr, !level);
+    }
+
+    bool pulse = !(flags & InterruptManagerFlags::DontUsePulseBasedInterrupts);
+    bool msi = flags & InterruptManagerFlags::MSIEnabled;
+    DBGLOG("GFXCon", "CZ IH: %s-based, %s (%s)", pulse ? "pulse" : "level", msi ? "MSI" : "legacy INTx",
+        callback->ihMode == IH_MODE_UNSET ? "interrupt manager" : "boot-arg");
+    auto *dict = OSDictionary::withCapacity(3);
+    if (!dict) { return; }
+    dict->setObject("Pulse", pulse ? kOSBooleanTrue : kOSBooleanFalse);
+    dict->setObject("MSI", msi ? kOSBooleanTrue : kOSBooleanFalse);
+    dict->setObject("BootArg", callback->ihMode != IH_MODE_UNSET ? kOSBooleanTrue : kOSBooleanFalse);
+    LRed::callback->iGPU->setProperty("LRed IH Mode", dict);
+    dict->release();
+}
+
+//! The IH writes its WPTR here on every update, so overflows can be checked without an MMIO read.
+//! It has to be physically contiguous and below 40 bits, the IH reaches it by bus address.
+void GFXCon::IHAllocWptrSlot() {
+    this->ihWptrBuffer = IOBufferMemoryDescriptor::inTaskWithPhysicalMask(kernel_task,
+        kIODirectionInOut | kIOMemoryPhysicallyContiguous, PAGE_SIZE, IH_WPTR_ADDR_MASK & ~0xFFFULL);
+    if (!this->ihWptrBuffer) {
+        SYSLOG("GFXCon", "Failed to allocate the IH WPTR write-back slot, overflows won't be recovered");
+        return;
+    }
+    if (this->ihWptrBuffer->prepare() != kIOReturnSuccess) {
+        SYSLOG("GFXCon", "Failed to prepare the IH WPTR write-back slot, overflows won't be recovered");
+        OSSafeReleaseNULL(this->ihWptrBuffer);
+        return;
+    }
+    this->ihWptrAddr = this->ihWptrBuffer->getPhysicalSegment(0, nullptr, kIOMemoryMapperNone);
+    this->ihWptr = static_cast<const volatile UInt32 *>(this->ihWptrBuffer->getBytesNoCopy());
+    DBGLOG("GFXCon", "IH WPTR write-back slot @ 0x%llX", this->ihWptrAddr);
+}
+
+void GFXCon::IHAttachRing(void *ihmgr) {
+    //! RB_SIZE is log2 of the size in dwords
+    callback->ihRingMask = (4U << callback->IHGetActiveRingBufferSizeRegValue(ihmgr)) - 1;
+    callback->ihRptr = 0;
+    callback->ihStats.attachRing(getMember<UInt64>(ihmgr, InterruptManagerFields::GPUAddress),
+        callback->ihRingMask + 1, callback->IHIsUsingVRAMForRingBuffer(ihmgr));
+}
+
+//! Ring programming, as in AMDGPU's `cz_ih_irq_init`.
+//! WPTR write-back goes to our own slot rather than the interrupt manager's, whose location isn't known. Rings in VRAM
+//! are left without it: the slot is only reachable by bus address, which the IH doesn't use for VRAM rings.
+void GFXCon::IHProgramRing(void *ihmgr) {
+    auto ringAddr = getMember<UInt64>(ihmgr, InterruptManagerFields::GPUAddress);
+    auto rbSize = callback->IHGetActiveRingBufferSizeRegValue(ihmgr);
+    bool msi = getMember<UInt32>(ihmgr, InterruptManagerFields::Flags) & InterruptManagerFlags::MSIEnabled;
+    bool vram = callback->IHIsUsingVRAMForRingBuffer(ihmgr);
+
+    RegBatch batch {LRed::callback};
+    //! The IH dummy read is only needed without MSI; snooping is only wanted for rings in system memory
+    batch.setField<INTERRUPT_CNTL__IH_DUMMY_RD_OVERRIDE_FIELD>(0);
+    batch.setField<INTERRUPT_CNTL__IH_REQ_NONSNOOP_EN_FIELD>(vram ? 1 : 0);
+    batch.write(mmIH_RB_BASE, static_cast<UInt32>(ringAddr >> 8));
+    callback->ihWriteBack = callback->ihWptr && !vram;
+    if (callback->ihWriteBack) {
+        *const_cast<volatile UInt32 *>(callback->ihWptr) = 0;
+        batch.write(mmIH_RB_WPTR_ADDR_LO, static_cast<UInt32>(callback->ihWptrAddr));
+        batch.write(mmIH_RB_WPTR_ADDR_HI, static_cast<UInt32>(callback->ihWptrAddr >> 32) & 0xFF);
+    } else {
+        batch.write(mmIH_RB_WPTR_ADDR_LO, 0);
+        batch.write(mmIH_RB_WPTR_ADDR_HI, 0);
+    }
+    batch.write(mmIH_RB_CNTL,
+        IH_RB_CNTL__RB_SIZE_FIELD::encode(rbSize) |
+            IH_RB_CNTL__WPTR_WRITEBACK_ENABLE_FIELD::encode(callback->ihWriteBack ? 1 : 0) |
+            IH_RB_CNTL__WPTR_OVERFLOW_ENABLE_FIELD::encode(1));
+    batch.write(mmIH_RB_RPTR, 0);
+    batch.write(mmIH_RB_WPTR, 0);
+    batch.setField<IH_CNTL__MC_VMID_FIELD>(0);
+    //! With MSI, the IH must be re-armed by an RPTR write before it sends another message
+    batch.setField<IH_CNTL__RPTR_REARM_FIELD>(msi ? 1 : 0);
+    batch.commit();
+
+    DBGLOG("GFXCon", "CZ IH: ring @ 0x%llX (%u bytes), MSI %d, WPTR write-back %d", ringAddr,
+        callback->ihRingMask + 1, msi, callback->ihWriteBack);
+}
+
 //! description:
 //! Properly power-up the IH, Tonga's OSS 3.0.0 uses a new bit in the RB_CNTL to fully
 //! get the IH ready for usage, this bit is not present on the OSS 3.0.1 IH and thus
@@ -114,39 +220,55 @@ void GFXCon::IHSetHardwareEnabled(void *ihmgr, bool enabled) {
     DBGLOG("GFXCon", "CZ IH @ setHardwareEnabled: enabled = 0x%x", enabled);
     if (enabled) {
         Support::callback->IHAcknowledgeAllOutStandingInterrupts(ihmgr);
+        IHApplyMode(ihmgr);
+        IHAttachRing(ihmgr);
+        IHDisable();
+        IHProgramRing(ihmgr);
         callback->IHSetRBReadPointer(ihmgr, 0);
         LRed::callback->writeReg32(mmIH_RB_WPTR, 0);    //! what
 
         IODelay(10);    //! give it a lil time to catch up
 
-        UInt32 tmp = LRed::callback->readReg32(mmIH_RB_CNTL);
-        UInt32 tmp2 = LRed::callback->readReg32(mmIH_CNTL);
-
-        if (tmp & IH_RB_CNTL__RB_ENABLE || tmp2 & IH_CNTL__ENABLE_INTR) {
-            DBGLOG("GFXCon", "CZ IH @ setHardwareEnabled (true): what.");
-        }
-
-        tmp |= IH_RB_CNTL__RB_ENABLE;
-        tmp2 |= IH_CNTL__ENABLE_INTR;
-
-        LRed::callback->writeReg32(mmIH_RB_CNTL, tmp);
-        LRed::callback->writeReg32(mmIH_CNTL, tmp2);
+        RegBatch batch {LRed::callback};
+        batch.setField<IH_RB_CNTL__RB_ENABLE_FIELD>(1);
+        batch.setField<IH_CNTL__ENABLE_INTR_FIELD>(1);
+        batch.commit();
     } else {
-        UInt32 tmp = LRed::callback->readReg32(mmIH_RB_CNTL);
-        UInt32 tmp2 = LRed::callback->readReg32(mmIH_CNTL);
-
-        //! assume that it's set
-        tmp &= ~IH_RB_CNTL__RB_ENABLE;
-        tmp2 &= ~IH_CNTL__ENABLE_INTR;
-
-        LRed::callback->writeReg32(mmIH_RB_CNTL, tmp);
-        LRed::callback->writeReg32(mmIH_CNTL, tmp2);
-
-        IODelay(10);    //! give it a lil time to catch up
-
+        IHDisable();
         callback->IHSetRBReadPointer(ihmgr, 0);
         LRed::callback->writeReg32(mmIH_RB_WPTR, 0);    //! what
         Support::callback->IHAcknowledgeAllOutStandingInterrupts(ihmgr);
     }
     getMember<char>(ihmgr, InterruptManagerFields::Unk1) = 0;    //! what
 }
+
+void GFXCon::IHDisable() {
+    //! assume that it's set
+    RegBatch batch {LRed::callback};
+    batch.setField<IH_RB_CNTL__RB_ENABLE_FIELD>(0);
+    batch.setField<IH_CNTL__ENABLE_INTR_FIELD>(0);
+    batch.commit();
+
+    IODelay(10);    //! give it a lil time to catch up
+}
+
+//! Called with the new RPTR once entries are consumed.
+//! On overflow, RPTR is moved to the oldest entry that wasn't overwritten, as in AMDGPU's `cz_ih_get_wptr`, instead of
+//! replaying the overwritten ones. The overflow bit comes from the write-back slot, so there's no MMIO read otherwise.
+void GFXCon::wrapIHSetRBReadPointer(void *ihmgr, UInt32 rptr) {
+    callback->ihStats.consume(callback->ihRptr, rptr);
+    if (callback->ihWriteBack) {
+        auto wptr = *callback->ihWptr;
+        if (UNLIKELY(IH_RB_WPTR__RB_OVERFLOW_FIELD::get(wptr))) {
+            wptr = IH_RB_WPTR__RB_OVERFLOW_FIELD::set(wptr, 0);
+            SYSLOG("GFXCon", "CZ IH ring overflow #%u (WPTR 0x%X, RPTR 0x%X)", callback->ihStats.noteOverflow(), wptr,
+                rptr);
+            rptr = (wptr + 16) & callback->ihRingMask;
+            //! WPTR_OVERFLOW_CLEAR is write-1-to-clear
+            auto cntl = LRed::callback->readReg32(mmIH_RB_CNTL);
+            LRed::callback->writeReg32(mmIH_RB_CNTL, IH_RB_CNTL__WPTR_OVERFLOW_CLEAR_FIELD::set(cntl, 1));
+        }
+    }
+    callback->ihRptr = rptr;
+    callback->IHSetRBReadPointer(ihmgr, rptr);
+}
@@ -3,14 +3,25 @@
 
 #pragma once
 #include "AMDCommon.hpp"
+#include "IHStats.hpp"
 #include "PatcherPlus.hpp"
 #include <Headers/kern_util.hpp>
+#include <IOKit/IOBufferMemoryDescriptor.h>
 
 using t_SetRBReadPointer = void (*)(void *that, UInt32 addr);
 using t_GetActiveRingBufferSizeRegValue = UInt32 (*)(void *that);
-using t_GetWPTRWriteBackOffset = long (*)(void *that);
 using t_IsUsingVRAMForRingBuffer = UInt32 (*)(void *that);
 
+//! `LRedIHMode` bits; without the boot-arg, the interrupt manager's own choice is kept.
+//! Per-mode latency isn't measured: OSS 3.0.1 IV entries carry no timestamp, so the time between the IH writing an
+//! entry and its RPTR update can't be recovered. Modes are compared by the entry rate in "LRed IH Stats" instead.
+constexpr UInt32 IH_MODE_LEVEL = 1 << 0;    //! Level-based instead of pulse-based interrupts
+constexpr UInt32 IH_MODE_MSI = 1 << 1;      //! MSI instead of legacy INTx, must match what the PCI function uses
+constexpr UInt32 IH_MODE_UNSET = 0xFFFFFFFF;
+
+//! IH_RB_WPTR_ADDR_HI only holds bits 39:32 of the write-back address
+constexpr UInt64 IH_WPTR_ADDR_MASK = 0xFFFFFFFFFFULL;
+
 class GFXCon {
     public:
     static GFXCon *callback;
@@ -20,13 +31,27 @@ class GFXCon {
     private:
     mach_vm_address_t orgPopulateDeviceInfo {0};
     mach_vm_address_t orgGetFamilyId {0};
-    t_SetRBReadPointer IHSetRBReadPointer;
-    t_GetWPTRWriteBackOffset IHGetWPTRWriteBackOffset;
-    t_GetActiveRingBufferSizeRegValue IHGetActiveRingBufferSizeRegValue;
-    t_IsUsingVRAMForRingBuffer IHIsUsingVRAMForRingBuffer;
+    t_SetRBReadPointer IHSetRBReadPointer {nullptr};
+    t_GetActiveRingBufferSizeRegValue IHGetActiveRingBufferSizeRegValue {nullptr};
+    t_IsUsingVRAMForRingBuffer IHIsUsingVRAMForRingBuffer {nullptr};
+    UInt32 ihRingMask {0};
+    UInt32 ihRptr {0};
+    UInt32 ihMode {IH_MODE_UNSET};
+    IOBufferMemoryDescriptor *ihWptrBuffer {nullptr};
+    const volatile UInt32 *ihWptr {nullptr};
+    UInt64 ihWptrAddr {0};
+    bool ihWriteBack {false};
+    IHStats ihStats;
 
     static IOReturn wrapPopulateDeviceInfo(void *that);
     static UInt16 wrapGetFamilyId(void);
 
+    static bool isMSIEnabled();
+    static void IHApplyMode(void *ihmgr);
+    void IHAllocWptrSlot();
+    static void IHAttachRing(void *ihmgr);
+    static void IHProgramRing(void *ihmgr);
+    static void IHDisable();
     static void IHSetHardwareEnabled(void *that, bool enabled);
+    static void wrapIHSetRBReadPointer(void *ihmgr, UInt32 rptr);
 };
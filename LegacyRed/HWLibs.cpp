@@ -38,14 +38,14 @@ bool HWLibs::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t
         CAILAsicCapsEntry *orgCapsTable = nullptr;
         CAILAsicCapsInitEntry *orgCapsInitTable = nullptr;
 
-        bool gcn3 = LRed::callback->chipType >= ChipType::Carrizo;
+        const auto &powerTune = powerTuneSymbols[static_cast<size_t>(LRed::callback->asic->powerTune)];
 
         SolveRequestPlus solveRequests[] = {
             {"__ZL20CAIL_ASIC_CAPS_TABLE", orgCapsTable},
             {"_CAILAsicCapsInitTable", orgCapsInitTable},
-            {gcn3 ? "__ZN30AtiAppleTongaPowerTuneServicesC1EP11PP_InstanceP18PowerPlayCallbacks" :
-                    "__ZN31AtiAppleHawaiiPowerTuneServicesC1EP11PP_InstanceP18PowerPlayCallbacks",
-                this->orgPowerTuneConstructor},
+            {powerTune.constructor, this->orgPowerTuneConstructor},
+            {powerTune.metaClass, this->powerTuneMetaClass},
+            {powerTune.vtable, this->powerTuneVtable},
         };
         PANIC_COND(!SolveRequestPlus::solveAll(patcher, index, solveRequests, address, size), "HWLibs",
             "Failed to resolve symbols");
@@ -65,24 +65,22 @@ bool HWLibs::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t
         };
         PANIC_COND(!LookupPatchPlus::applyAll(patcher, patches, address, size), "HWLibs", "Failed to apply patches!");
 
-        UInt32 targetDeviceId = LRed::callback->deviceId;
-        UInt32 targetFamilyId = LRed::callback->familyId;
-        for (auto *tmp = orgCapsInitTable; tmp->deviceId != 0xFFFFFFFF; tmp++) {
-            if (tmp->familyId == targetFamilyId && tmp->deviceId == targetDeviceId) {
-                PANIC_COND(MachInfo::setKernelWriting(true, KernelPatcher::kernelWriteLock) != KERN_SUCCESS, "HWLibs",
-                    "Failed to enable kernel writing");
-                orgCapsTable->familyId = LRed::callback->familyId;
-                orgCapsTable->deviceId = LRed::callback->deviceId;
-                orgCapsTable->revision = LRed::callback->revision;
-                orgCapsTable->extRevision = static_cast<UInt32>(LRed::callback->emulatedRevision);
-                orgCapsTable->pciRevision = LRed::callback->pciRevision;
-                orgCapsTable->caps = tmp->caps;
-                *orgCapsInitTable = *tmp;
-                MachInfo::setKernelWriting(false, KernelPatcher::kernelWriteLock);
-                break;
-            }
-        }
-        PANIC_COND(orgCapsInitTable->deviceId == 0xFFFFFFFF, "HWLibs", "Failed to find init caps table entry");
+        //! CAIL uses the two tables in parallel by index, so our row in the init table is our row in the caps table
+        //! too. Only that row is rewritten, the rows of other ASICs stay as AMD shipped them.
+        this->buildCapsIndex(orgCapsInitTable);
+        UInt32 row = 0;
+        PANIC_COND(!this->findCapsRow(LRed::callback->familyId, LRed::callback->deviceId, row), "HWLibs",
+            "Failed to find init caps table entry");
+        auto &capsSlot = orgCapsTable[row];
+        PANIC_COND(capsSlot.familyId != LRed::callback->familyId || capsSlot.deviceId != LRed::callback->deviceId,
+            "HWLibs", "Caps table row %u is for 0x%X:0x%X, not ours", row, capsSlot.familyId, capsSlot.deviceId);
+        this->buildCapsEntry(capsSlot, orgCapsInitTable[row]);
+        publishGoldenSettings(orgCapsInitTable[row].goldenCaps);
+
+        PANIC_COND(MachInfo::setKernelWriting(true, KernelPatcher::kernelWriteLock) != KERN_SUCCESS, "HWLibs",
+            "Failed to enable kernel writing");
+        capsSlot = this->capsEntry;
+        MachInfo::setKernelWriting(false, KernelPatcher::kernelWriteLock);
         DBGLOG("HWLibs", "Applied DDI Caps patches");
         return true;
     }
@@ -90,6 +88,62 @@ bool HWLibs::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t
     return false;
 }
 
+void HWLibs::buildCapsIndex(const CAILAsicCapsInitEntry *table) {
+    this->capsIndexCount = 0;
+    for (UInt32 row = 0; table[row].deviceId != CAIL_TABLE_END; row++) {
+        PANIC_COND(this->capsIndexCount == MAX_CAIL_CAPS_ROWS, "HWLibs", "Too many caps table rows");
+        auto key = capsKey(table[row].familyId, table[row].deviceId);
+        //! Insertion sort, equal keys keep their table order so the first row for a device wins
+        auto i = this->capsIndexCount++;
+        for (; i && this->capsIndex[i - 1].key > key; i--) { this->capsIndex[i] = this->capsIndex[i - 1]; }
+        this->capsIndex[i] = {key, row};
+    }
+    DBGLOG("HWLibs", "Indexed %zu caps table rows", this->capsIndexCount);
+}
+
+bool HWLibs::findCapsRow(UInt32 familyId, UInt32 deviceId, UInt32 &row) const {
+    auto key = capsKey(familyId, deviceId);
+    size_t low = 0, high = this->capsIndexCount;
+    while (low < high) {
+        auto mid = (low + high) / 2;
+        if (this->capsIndex[mid].key < key) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low == this->capsIndexCount || this->capsIndex[low].key != key) { return false; }
+    row = this->capsIndex[low].row;
+    return true;
+}
+
+void HWLibs::buildCapsEntry(const CAILAsicCapsEntry &slot, const CAILAsicCapsInitEntry &initEntry) {
+    this->capsEntry = slot;
+    this->capsEntry.revision = LRed::callback->revision;
+    this->capsEntry.extRevision = static_cast<UInt32>(LRed::callback->emulatedRevision);
+    this->capsEntry.pciRevision = LRed::callback->pciRevision;
+    this->capsEntry.caps = initEntry.caps;
+}
+
+void HWLibs::publishGoldenSettings(const CAILASICGoldenSettings *settings) {
+    if (!settings || !settings->goldenRegisterSettings) {
+        DBGLOG("HWLibs", "No golden settings for this ASIC");
+        return;
+    }
+
+    UInt32 count = 0;
+    while (count < MAX_GOLDEN_SETTINGS && settings->goldenRegisterSettings[count].offset != CAIL_TABLE_END) { count++; }
+    GoldenSettingsBlobHeader header {GOLDEN_BLOB_MAGIC, GOLDEN_BLOB_VERSION,
+        static_cast<UInt16>(LRed::callback->chipType), LRed::callback->familyId, LRed::callback->deviceId, count};
+    auto size = static_cast<UInt32>(sizeof(CAILASICGoldenRegisterSettings) * count);
+    auto *data = OSData::withCapacity(static_cast<UInt32>(sizeof(header)) + size);
+    if (!data) { return; }
+    data->appendBytes(&header, sizeof(header));
+    data->appendBytes(settings->goldenRegisterSettings, size);
+    LRed::callback->iGPU->setProperty("LRed Golden Settings", data);
+    data->release();
+}
+
 const char *HWLibs::forceX4000HWLibs() {
     DBGLOG("HWServices", "Forcing HWServices to load X4000HWLibs");
     //! By default, X4000HWServices on CI loads X4050HWLibs, we override this here because X4050 has no KV logic.
@@ -103,9 +157,21 @@ void HWLibs::wrapAmdCailServicesConstructor(void *that, IOPCIDevice *provider) {
     FunctionCast(wrapAmdCailServicesConstructor, callback->orgAmdCailServicesConstructor)(that, provider);
 }
 
+//! The size comes from the metaclass, which is only constructed once the kext has started, so not at patch time
 void *HWLibs::wrapCreatePowerTuneServices(void *that, void *param2) {
-    auto *ret = OSObject::operator new(0x18);
+    auto size = callback->powerTuneMetaClass->getClassSize();
+    PANIC_COND(size < sizeof(OSObject), "HWLibs", "Invalid %s size 0x%X", callback->powerTuneMetaClass->getClassName(),
+        size);
+    DBGLOG("HWLibs", "Creating %s, size 0x%X", callback->powerTuneMetaClass->getClassName(), size);
+    auto *ret = OSObject::operator new(size);
+    PANIC_COND(!ret, "HWLibs", "Failed to allocate PowerTune services");
+    bzero(ret, size);
     callback->orgPowerTuneConstructor(ret, that, param2);
+    //! Itanium ABI: the object's vtable pointer skips the offset-to-top and RTTI slots
+    auto vtable = *static_cast<mach_vm_address_t *>(ret);
+    PANIC_COND(vtable != callback->powerTuneVtable + 2 * sizeof(void *), "HWLibs",
+        "PowerTune services vtable mismatch: 0x%llX", vtable);
+    callback->powerTuneServices = ret;
     return ret;
 }
 
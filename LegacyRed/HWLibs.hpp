@@ -10,6 +10,42 @@
 using t_XPowerTuneConstructor = void (*)(void *that, void *ppInstance, void *ppCallbacks);
 using t_sendMsgToSmc = UInt32 (*)(void *smum, UInt32 msgId);
 
+constexpr UInt32 CAIL_TABLE_END = 0xFFFFFFFF;
+constexpr size_t MAX_GOLDEN_SETTINGS = 256;
+constexpr size_t MAX_CAIL_CAPS_ROWS = 256;
+
+//! 'LRGS'
+constexpr UInt32 GOLDEN_BLOB_MAGIC = 0x5347524C;
+constexpr UInt16 GOLDEN_BLOB_VERSION = 1;
+
+//! Followed by `count` `CAILASICGoldenRegisterSettings`, decoded by `Scripts/GoldenSettings.py`
+struct GoldenSettingsBlobHeader {
+    UInt32 magic;
+    UInt16 version;
+    UInt16 chipType;
+    UInt32 familyId;
+    UInt32 deviceId;
+    UInt32 count;
+} PACKED;
+
+//! A row of CAIL's caps tables, `key` is `familyId << 32 | deviceId`
+struct CAILCapsIndexEntry {
+    UInt64 key;
+    UInt32 row;
+};
+
+struct PowerTuneSymbols {
+    const char *constructor, *metaClass, *vtable;
+};
+
+//! Indexed by `PowerTuneVariant`
+static constexpr PowerTuneSymbols powerTuneSymbols[] = {
+    {"__ZN31AtiAppleHawaiiPowerTuneServicesC1EP11PP_InstanceP18PowerPlayCallbacks",
+        "__ZN31AtiAppleHawaiiPowerTuneServices10gMetaClassE", "__ZTV31AtiAppleHawaiiPowerTuneServices"},
+    {"__ZN30AtiAppleTongaPowerTuneServicesC1EP11PP_InstanceP18PowerPlayCallbacks",
+        "__ZN30AtiAppleTongaPowerTuneServices10gMetaClassE", "__ZTV30AtiAppleTongaPowerTuneServices"},
+};
+
 class HWLibs {
     public:
     static HWLibs *callback;
@@ -18,8 +54,22 @@ class HWLibs {
 
     private:
     t_XPowerTuneConstructor orgPowerTuneConstructor {nullptr};
+    const OSMetaClass *powerTuneMetaClass {nullptr};
+    mach_vm_address_t powerTuneVtable {0};
+    //! The PowerTune services object PowerPlay created, for hooks that need its state
+    void *powerTuneServices {nullptr};
     mach_vm_address_t orgAmdCailServicesConstructor {0};
     mach_vm_address_t orgBonairePerformSrbmReset {0};
+    CAILAsicCapsEntry capsEntry {};
+    //! Sorted by key, built once from `CAILAsicCapsInitTable`
+    CAILCapsIndexEntry capsIndex[MAX_CAIL_CAPS_ROWS] {};
+    size_t capsIndexCount {0};
+
+    static UInt64 capsKey(UInt64 familyId, UInt64 deviceId) { return familyId << 32 | (deviceId & 0xFFFFFFFF); }
+    void buildCapsIndex(const CAILAsicCapsInitEntry *table);
+    bool findCapsRow(UInt32 familyId, UInt32 deviceId, UInt32 &row) const;
+    void buildCapsEntry(const CAILAsicCapsEntry &slot, const CAILAsicCapsInitEntry &initEntry);
+    static void publishGoldenSettings(const CAILASICGoldenSettings *settings);
 
     static const char *forceX4000HWLibs();
 
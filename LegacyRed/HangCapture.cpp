@@ -0,0 +1,91 @@
+//! Copyright © 2024 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.5.
+//! See LICENSE for details.
+
+#include "HangCapture.hpp"
+#include "LRed.hpp"
+#include "X4000.hpp"
+#include <Headers/kern_nvram.hpp>
+#include <kern/clock.h>
+#include <libkern/OSAtomic.h>
+
+void HangCapture::init(size_t tailRecordSize) {
+    if (this->buffer) { return; }
+    this->tailRecordSize = tailRecordSize;
+    this->bufferSize = sizeof(HangSnapshotHeader) + sizeof(HangSnapshotReg) * arrsize(hangSnapshotRegs) +
+                       tailRecordSize * HANG_SNAPSHOT_MAX_TAIL_RECORDS;
+    this->publishCall = thread_call_allocate(publishThread, this);
+    if (!this->publishCall) {
+        SYSLOG("HangCap", "Failed to allocate publish thread call");
+        return;
+    }
+    this->buffer = new UInt8[this->bufferSize];
+    if (!this->buffer) { SYSLOG("HangCap", "Failed to allocate snapshot buffer"); }
+}
+
+size_t HangCapture::serialize(UInt8 *out, size_t outSize, HangReason reason, const char *message, UInt64 timestamp,
+    const UInt32 *values, const void *tail, size_t tailCount, size_t tailRecordSize) {
+    auto regsSize = sizeof(HangSnapshotReg) * arrsize(hangSnapshotRegs);
+    if (outSize < sizeof(HangSnapshotHeader) + regsSize) { return 0; }
+    auto maxTail = (outSize - sizeof(HangSnapshotHeader) - regsSize) / (tailRecordSize ? tailRecordSize : 1);
+    if (tailCount > maxTail) { tailCount = maxTail; }
+
+    auto *header = reinterpret_cast<HangSnapshotHeader *>(out);
+    bzero(header, sizeof(*header));
+    header->magic = HANG_SNAPSHOT_MAGIC;
+    header->version = HANG_SNAPSHOT_VERSION;
+    header->reason = static_cast<UInt16>(reason);
+    header->timestamp = timestamp;
+    header->regCount = static_cast<UInt32>(arrsize(hangSnapshotRegs));
+    header->tailCount = static_cast<UInt32>(tailCount);
+    header->tailRecordSize = static_cast<UInt32>(tailRecordSize);
+    if (message) { strlcpy(header->message, message, sizeof(header->message)); }
+
+    auto *regs = reinterpret_cast<HangSnapshotReg *>(header + 1);
+    for (size_t i = 0; i < arrsize(hangSnapshotRegs); i++) { regs[i] = {hangSnapshotRegs[i], values[i]}; }
+
+    auto *tailOut = reinterpret_cast<UInt8 *>(regs + arrsize(hangSnapshotRegs));
+    if (tailCount) { memmove(tailOut, tail, tailCount * tailRecordSize); }
+    return static_cast<size_t>(tailOut - out) + tailCount * tailRecordSize;
+}
+
+//! Called from the hang/panic path, so only register reads and copies into the preallocated buffer happen here
+void HangCapture::capture(HangReason reason, const char *message) {
+    if (!this->buffer || !OSCompareAndSwap(0, 1, &this->captured)) { return; }
+
+    UInt32 values[arrsize(hangSnapshotRegs)];
+    for (size_t i = 0; i < arrsize(hangSnapshotRegs); i++) {
+        values[i] = LRed::callback->readReg32(hangSnapshotRegs[i]);
+    }
+
+    //! The tail is copied straight into its final place, `serialize` leaves it there
+    auto tailOffset = sizeof(HangSnapshotHeader) + sizeof(HangSnapshotReg) * arrsize(hangSnapshotRegs);
+    this->tailCount = X4000::callback->copyRingTraceTail(this->buffer + tailOffset, HANG_SNAPSHOT_MAX_TAIL_RECORDS,
+        HANG_SNAPSHOT_TAIL_PER_RING);
+    this->snapshotSize = serialize(this->buffer, this->bufferSize, reason, message, mach_absolute_time(), values,
+        this->buffer + tailOffset, this->tailCount, this->tailRecordSize);
+    thread_call_enter(this->publishCall);
+}
+
+void HangCapture::publishThread(thread_call_param_t param0, thread_call_param_t) {
+    static_cast<HangCapture *>(param0)->publish();
+}
+
+void HangCapture::publish() {
+    const auto *header = reinterpret_cast<const HangSnapshotHeader *>(this->buffer);
+    SYSLOG("HangCap", "Captured hang snapshot (reason %u, %zu trace records)", header->reason, this->tailCount);
+
+    auto *data = OSData::withBytes(this->buffer, static_cast<UInt32>(this->snapshotSize));
+    if (data) {
+        LRed::callback->iGPU->setProperty("LRed Hang Snapshot", data);
+        data->release();
+    }
+
+    auto tailOffset = sizeof(HangSnapshotHeader) + sizeof(HangSnapshotReg) * arrsize(hangSnapshotRegs);
+    NVStorage storage;
+    if (storage.init()) {
+        if (!storage.write("lred-hang-snapshot", this->buffer, static_cast<UInt32>(tailOffset), NVStorage::OptRaw)) {
+            SYSLOG("HangCap", "Failed to write hang snapshot to NVRAM");
+        }
+        storage.deinit();
+    }
+}
@@ -0,0 +1,83 @@
+//! Copyright © 2024 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.5.
+//! See LICENSE for details.
+
+#pragma once
+#include "AMDCommon.hpp"
+#include <Headers/kern_util.hpp>
+#include <IOKit/IOService.h>
+#include <kern/thread_call.h>
+
+//! 'LRHS'
+constexpr UInt32 HANG_SNAPSHOT_MAGIC = 0x5348524C;
+constexpr UInt16 HANG_SNAPSHOT_VERSION = 1;
+constexpr size_t HANG_SNAPSHOT_MESSAGE_SIZE = 64;
+//! Ring write trace records kept per traced ring
+constexpr size_t HANG_SNAPSHOT_TAIL_PER_RING = 8;
+constexpr size_t HANG_SNAPSHOT_MAX_TAIL_RECORDS = 64;
+
+enum struct HangReason : UInt16 {
+    ASICHangState = 1,    //! `AMDHardware::dumpASICHangState`
+    GPUPanic,             //! `ATIController::doGPUPanic`
+};
+
+//! Registers captured on a hang, in this order
+static constexpr UInt32 hangSnapshotRegs[] = {
+    mmSRBM_STATUS,
+    mmSRBM_STATUS2,
+    mmGRBM_STATUS,
+    mmGRBM_STATUS2,
+    mmCP_STAT,
+    mmCP_ME_CNTL,
+    mmCP_RB0_BASE,
+    mmCP_RB0_CNTL,
+    mmCP_RB0_RPTR,
+    mmCP_RB0_WPTR,
+    mmVM_CONTEXT1_PROTECTION_FAULT_STATUS,
+    mmVM_CONTEXT1_PROTECTION_FAULT_ADDR,
+    mmIH_RB_CNTL,
+    mmIH_RB_RPTR,
+    mmIH_RB_WPTR,
+    mmIH_STATUS,
+};
+
+//! The snapshot is the header, `regCount` register/value pairs, then `tailCount` ring write trace records
+struct HangSnapshotHeader {
+    UInt32 magic;
+    UInt16 version;
+    UInt16 reason;
+    UInt64 timestamp;
+    UInt32 regCount;
+    UInt32 tailCount;
+    UInt32 tailRecordSize;
+    UInt32 reserved;
+    char message[HANG_SNAPSHOT_MESSAGE_SIZE];
+} PACKED;
+
+struct HangSnapshotReg {
+    UInt32 reg;
+    UInt32 value;
+} PACKED;
+
+//! Snapshots the GPU state once when it wedges, into a buffer allocated up front as we may not be able to allocate
+//! then. `capture` only fills the buffer; a thread call allocated with it then puts the full snapshot in the
+//! IORegistry, and the header and registers in NVRAM to survive the reboot. If the hang turns into a panic before
+//! that thread call runs, the snapshot is lost.
+class HangCapture {
+    UInt8 *buffer {nullptr};
+    size_t bufferSize {0};
+    size_t tailRecordSize {0};
+    size_t snapshotSize {0};
+    size_t tailCount {0};
+    volatile UInt32 captured {0};
+    thread_call_t publishCall {nullptr};
+
+    void publish();
+    static void publishThread(thread_call_param_t param0, thread_call_param_t param1);
+
+    public:
+    void init(size_t tailRecordSize);
+    void capture(HangReason reason, const char *message);
+
+    static size_t serialize(UInt8 *out, size_t outSize, HangReason reason, const char *message, UInt64 timestamp,
+        const UInt32 *values, const void *tail, size_t tailCount, size_t tailRecordSize);
+};
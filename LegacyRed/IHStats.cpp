@@ -0,0 +1,145 @@
+//! Copyright © 2024 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.5.
+//! See LICENSE for details.
+
+#include "IHStats.hpp"
+#include "LRed.hpp"
+#include <kern/clock.h>
+#include <kern/cpu_number.h>
+#include <libkern/OSAtomic.h>
+
+void IHStats::init(IOPCIDevice *provider) {
+    if (this->buckets || !checkKernelArgument("-LRedIHStats")) { return; }
+
+    this->provider = provider;
+    this->publishCall = thread_call_allocate(publishTimer, this);
+    if (!this->publishCall) {
+        SYSLOG("IHStats", "Failed to allocate publish thread call");
+        return;
+    }
+    clock_interval_to_absolutetime_interval(IH_STATS_PUBLISH_INTERVAL_MS, kMillisecondScale, &this->publishInterval);
+    this->buckets = new IHStatsBucket[IH_STATS_CPU_BUCKETS]();
+    this->lastPublish = mach_absolute_time();
+    thread_call_enter_delayed(this->publishCall, this->lastPublish + this->publishInterval);
+    DBGLOG("IHStats", "Collecting IH statistics");
+}
+
+void IHStats::freeView(IHRingView *view) {
+    if (!view) { return; }
+    OSSafeReleaseNULL(view->map);
+    delete view;
+}
+
+void IHStats::attachRing(UInt64 gpuAddr, UInt32 size, bool vram) {
+    if (!this->buckets) { return; }
+    this->ringMask = size - 1;
+
+    //! `setHardwareEnabled` runs on every power transition, but the ring rarely moves
+    auto *current = this->view;
+    if (current && vram && current->gpuAddr == gpuAddr && current->mask == size - 1) { return; }
+
+    IHRingView *newView = nullptr;
+    auto &addressSpace = LRed::callback->addressSpace;
+    if (!vram || gpuAddr < addressSpace.vramStart || gpuAddr + size > addressSpace.vramEnd + 1) {
+        DBGLOG("IHStats", "IH ring @ 0x%llX isn't in VRAM, only counting entries", gpuAddr);
+    } else {
+        auto *bar = this->provider->getDeviceMemoryWithRegister(kIOPCIConfigBaseAddress0);
+        auto *range = bar ? IODeviceMemory::withSubRange(bar, gpuAddr - addressSpace.vramStart, size) : nullptr;
+        auto *map = range ? range->map() : nullptr;
+        OSSafeReleaseNULL(range);
+        if (map) {
+            newView = new IHRingView {map, reinterpret_cast<const volatile UInt32 *>(map->getVirtualAddress()),
+                gpuAddr, size - 1};
+        } else {
+            SYSLOG("IHStats", "Failed to map the IH ring, only counting entries");
+        }
+    }
+
+    //! Publish the new view before letting go of anything `consume` may still be reading
+    OSMemoryBarrier();
+    this->view = newView;
+    OSMemoryBarrier();
+    freeView(this->retiredView);
+    this->retiredView = current;
+}
+
+void IHStats::consume(UInt32 rptr, UInt32 newRptr) {
+    if (!this->buckets) { return; }
+    auto &bucket = this->buckets[static_cast<size_t>(cpu_number()) % IH_STATS_CPU_BUCKETS];
+    UInt32 count = ((newRptr - rptr) & this->ringMask) / IH_ENTRY_SIZE;
+    OSAddAtomic64(count, &bucket.entries);
+    auto *view = this->view;
+    if (!view || !count) { return; }
+    auto decode = count < IH_STATS_DECODE_MAX ? count : IH_STATS_DECODE_MAX;
+    auto offset = (rptr + (count - decode) * IH_ENTRY_SIZE) & view->mask;
+    for (UInt32 i = 0; i < decode; i++, offset = (offset + IH_ENTRY_SIZE) & view->mask) {
+        auto entry = IHEntry::decode(view->ring + offset / sizeof(UInt32));
+        OSIncrementAtomic(&bucket.sources[entry.sourceId]);
+        this->lastEntry = entry.pack();
+    }
+    OSAddAtomic64(decode, &bucket.decoded);
+}
+
+UInt32 IHStats::noteOverflow() { return static_cast<UInt32>(OSIncrementAtomic(&this->overflows)) + 1; }
+
+void IHStats::publishTimer(thread_call_param_t param0, thread_call_param_t) {
+    auto *that = static_cast<IHStats *>(param0);
+    that->publish();
+    thread_call_enter_delayed(that->publishCall, mach_absolute_time() + that->publishInterval);
+}
+
+void IHStats::publish() {
+    UInt64 entries = 0, decoded = 0;
+    for (size_t cpu = 0; cpu < IH_STATS_CPU_BUCKETS; cpu++) {
+        entries += static_cast<UInt64>(this->buckets[cpu].entries);
+        decoded += static_cast<UInt64>(this->buckets[cpu].decoded);
+    }
+    auto lastEntry = IHEntry::unpack(this->lastEntry);
+    auto now = mach_absolute_time();
+    uint64_t elapsedNs = 0;
+    absolutetime_to_nanoseconds(now - this->lastPublish, &elapsedNs);
+    auto rate = elapsedNs ? (entries - this->lastEntries) * 1000000000ULL / elapsedNs : 0;
+    this->lastEntries = entries;
+    this->lastPublish = now;
+
+    auto *dict = OSDictionary::withCapacity(8);
+    if (!dict) { return; }
+    const struct {
+        const char *name;
+        UInt64 value;
+    } numbers[] = {
+        {"Entries", entries},
+        {"EntriesPerSecond", rate},
+        {"DecodedEntries", decoded},
+        {"Overflows", static_cast<UInt32>(this->overflows)},
+        {"LastSourceId", lastEntry.sourceId},
+        {"LastSourceData", lastEntry.sourceData},
+        {"LastRingId", lastEntry.ringId},
+        {"LastVMID", lastEntry.vmid},
+    };
+    for (auto &entry : numbers) {
+        auto *num = OSNumber::withNumber(entry.value, 64);
+        if (!num) { continue; }
+        dict->setObject(entry.name, num);
+        num->release();
+    }
+    auto *sources = OSDictionary::withCapacity(16);
+    if (sources) {
+        for (size_t source = 0; source < IH_SOURCE_COUNT; source++) {
+            UInt64 count = 0;
+            for (size_t cpu = 0; cpu < IH_STATS_CPU_BUCKETS; cpu++) {
+                count += static_cast<UInt32>(this->buckets[cpu].sources[source]);
+            }
+            if (!count) { continue; }
+            char name[8];
+            snprintf(name, sizeof(name), "0x%02zX", source);
+            auto *num = OSNumber::withNumber(count, 64);
+            if (!num) { continue; }
+            sources->setObject(name, num);
+            num->release();
+        }
+        dict->setObject("Sources", sources);
+        sources->release();
+    }
+    this->provider->setProperty("LRed IH Stats", dict);
+    dict->release();
+}
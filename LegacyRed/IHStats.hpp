@@ -0,0 +1,98 @@
+//! Copyright © 2024 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.5.
+//! See LICENSE for details.
+
+#pragma once
+#include <Headers/kern_util.hpp>
+#include <IOKit/pci/IOPCIDevice.h>
+#include <kern/thread_call.h>
+
+constexpr size_t IH_ENTRY_SIZE = 16;
+constexpr size_t IH_STATS_CPU_BUCKETS = 16;
+constexpr size_t IH_SOURCE_COUNT = 256;
+constexpr UInt32 IH_STATS_PUBLISH_INTERVAL_MS = 1000;
+//! At most this many of the newest entries are decoded per RPTR update, each costs three uncached reads
+constexpr UInt32 IH_STATS_DECODE_MAX = 4;
+
+//! A decoded OSS 3.0.1 IH ring entry, see AMDGPU's `cz_ih_decode_iv`.
+//! This IH predates client IDs, every source is on the legacy client.
+struct IHEntry {
+    UInt8 sourceId;
+    UInt8 ringId;
+    UInt8 vmid;
+    UInt16 pasid;
+    UInt32 sourceData;
+
+    static IHEntry decode(const volatile UInt32 *dw) {
+        UInt32 dw2 = dw[2];
+        return {
+            static_cast<UInt8>(dw[0] & 0xFF),
+            static_cast<UInt8>(dw2 & 0xFF),
+            static_cast<UInt8>((dw2 >> 8) & 0xFF),
+            static_cast<UInt16>(dw2 >> 16),
+            dw[1] & 0xFFFFFFF,
+        };
+    }
+
+    //! Packed into one word so it's stored and read in a single access, PASID is left out since it's not published
+    UInt64 pack() const {
+        return static_cast<UInt64>(this->sourceData) | static_cast<UInt64>(this->vmid) << 28 |
+               static_cast<UInt64>(this->ringId) << 36 | static_cast<UInt64>(this->sourceId) << 44;
+    }
+
+    static IHEntry unpack(UInt64 packed) {
+        return {
+            static_cast<UInt8>((packed >> 44) & 0xFF),
+            static_cast<UInt8>((packed >> 36) & 0xFF),
+            static_cast<UInt8>((packed >> 28) & 0xFF),
+            0,
+            static_cast<UInt32>(packed & 0xFFFFFFF),
+        };
+    }
+};
+
+//! A CPU mapping of the IH ring, never changed once published
+struct IHRingView {
+    IOMemoryMap *map;
+    const volatile UInt32 *ring;
+    UInt64 gpuAddr;
+    UInt32 mask;
+};
+
+//! Counters are bumped atomically: `consume` runs with preemption enabled, so the thread can migrate between picking
+//! its bucket and updating it, and another CPU's RPTR update may share the bucket.
+struct IHStatsBucket {
+    volatile SInt64 entries;
+    volatile SInt64 decoded;
+    volatile SInt32 sources[IH_SOURCE_COUNT];
+};
+
+//! Per-source IH entry counts and the overall interrupt rate, collected with `-LRedIHStats`.
+//! Entries are counted as the interrupt manager consumes them, from its RPTR updates; they're only decoded when the
+//! ring is in VRAM, where it can be reached through the FB BAR. Decoding costs three uncached reads across the BAR per
+//! entry, on the interrupt manager's RPTR path, so only the newest `IH_STATS_DECODE_MAX` entries of each update are
+//! decoded and the per-source counts are a sample of `DecodedEntries`, not of `Entries`.
+//! `consume` reads `view` once and may still be using it when the ring is remapped, so a replaced view is kept alive
+//! until the next remap; remaps only happen while the IH is being re-enabled.
+class IHStats {
+    IOPCIDevice *provider {nullptr};
+    IHStatsBucket *buckets {nullptr};
+    IHRingView *volatile view {nullptr};
+    IHRingView *retiredView {nullptr};
+    UInt32 ringMask {0};
+    volatile UInt64 lastEntry {0};
+    volatile SInt32 overflows {0};
+    thread_call_t publishCall {nullptr};
+    uint64_t publishInterval {0};
+    UInt64 lastEntries {0};
+    UInt64 lastPublish {0};
+
+    void publish();
+    static void freeView(IHRingView *view);
+    static void publishTimer(thread_call_param_t param0, thread_call_param_t param1);
+
+    public:
+    void init(IOPCIDevice *provider);
+    void attachRing(UInt64 gpuAddr, UInt32 size, bool vram);
+    void consume(UInt32 rptr, UInt32 newRptr);
+    UInt32 noteOverflow();
+};
@@ -0,0 +1,38 @@
+//! Copyright © 2024 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.5.
+//! See LICENSE for details.
+
+#pragma once
+#include <Headers/kern_util.hpp>
+#include <IOKit/IOLib.h>
+
+//! An index/data register pair used to reach registers outside of the MMIO BAR.
+//! The index and data accesses of one transaction must not interleave with another CPU's, hence the lock.
+//! Interrupts are disabled while it's held as the pair may be used from interrupt context.
+class IndirectRegPair {
+    const UInt32 indexReg, dataReg;
+    IOSimpleLock *lock {nullptr};
+
+    public:
+    constexpr IndirectRegPair(UInt32 indexReg, UInt32 dataReg) : indexReg {indexReg}, dataReg {dataReg} {}
+
+    void init() {
+        if (this->lock) { return; }
+        this->lock = IOSimpleLockAlloc();
+        PANIC_COND(!this->lock, "IndRegs", "Failed to allocate lock for 0x%X/0x%X", this->indexReg, this->dataReg);
+    }
+
+    UInt32 read(volatile UInt32 *mmio, UInt32 reg) {
+        auto state = IOSimpleLockLockDisableInterrupt(this->lock);
+        mmio[this->indexReg] = reg;
+        UInt32 ret = mmio[this->dataReg];
+        IOSimpleLockUnlockEnableInterrupt(this->lock, state);
+        return ret;
+    }
+
+    void write(volatile UInt32 *mmio, UInt32 reg, UInt32 val) {
+        auto state = IOSimpleLockLockDisableInterrupt(this->lock);
+        mmio[this->indexReg] = reg;
+        mmio[this->dataReg] = val;
+        IOSimpleLockUnlockEnableInterrupt(this->lock, state);
+    }
+};
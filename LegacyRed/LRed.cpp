@@ -12,6 +12,7 @@
 #include <Headers/kern_devinfo.hpp>
 #include <IOKit/IOCatalogue.h>
 #include <IOKit/IODeviceTreeSupport.h>
+#include <sys/sysctl.h>
 
 static const char *pathAGDP = "/System/Library/Extensions/AppleGraphicsControl.kext/Contents/PlugIns/"
                               "AppleGraphicsDevicePolicy.kext/Contents/MacOS/AppleGraphicsDevicePolicy";
@@ -100,6 +101,8 @@ void LRed::processPatcher(KernelPatcher &patcher) {
 
         if (UNLIKELY(this->iGPU->getProperty("ATY,bin_image"))) {
             DBGLOG("LRed", "VBIOS manually overridden");
+            this->vbiosData = OSDynamicCast(OSData, this->iGPU->getProperty("ATY,bin_image"));
+            if (this->vbiosData) { this->vbiosData->retain(); }
         } else {
             if (!this->getVBIOSFromVFCT(this->iGPU)) {
                 SYSLOG("LRed", "Failed to get VBIOS from VFCT.");
@@ -107,6 +110,8 @@ void LRed::processPatcher(KernelPatcher &patcher) {
             }
         }
 
+        if (this->vbiosData) { this->parseDisplayObjects(); }
+
         DeviceInfo::deleter(devInfo);
     } else {
         SYSLOG("LRed", "Failed to create DeviceInfo");
@@ -169,109 +174,251 @@ void LRed::setRMMIOIfNecessary() {
     if (UNLIKELY(!this->rmmio || !this->rmmio->getLength())) {
         this->rmmio = this->iGPU->mapDeviceMemoryWithRegister(kIOPCIConfigBaseAddress5);
         PANIC_COND(!this->rmmio || !this->rmmio->getLength(), "LRed", "Failed to map RMMIO");
-        this->rmmioPtr = reinterpret_cast<volatile uint32_t *>(this->rmmio->getVirtualAddress());
-
-        this->fbOffset = static_cast<UInt64>(this->readReg32(mmMC_VM_FB_OFFSET)) << 22;
-        SYSLOG("LRed", "Framebuffer offset: 0x%llX", this->fbOffset);
-
-        this->mcLocation = (this->readReg32(mmMC_VM_FB_LOCATION) << 24);
-        this->memSize = ((this->readReg32(mmCONFIG_MEMSIZE) * 1024) * 1024);
-        this->vramStart = (APU_COMMON_VRAM_PADDR + this->mcLocation);
-        this->vramEnd = ((this->vramStart + memSize) - 1);
-
-        SYSLOG("LRed", "VRAM: Size %lluMB, Start: 0x%llx, End: 0x%llx", ((this->memSize / 1024ULL) / 1024ULL), this->vramStart, this->vramEnd);
-
-        //! Who thought it would be a good idea to use this many Device IDs and Revisions?
-        switch (this->deviceId) {
-            case 0x1309 ... 0x131D:
-                this->familyId = AMDGPU_FAMILY_KV;
-                if (this->deviceId == 0x1312 || this->deviceId == 0x1316 || this->deviceId == 0x1317) {
-                    this->chipType = ChipType::Spooky;
-                    this->chipVariant = ChipVariant::Kaveri;
-                    this->enumeratedRevision = 0x41;
-                    DBGLOG("LRed", "Chip type Spooky, Kaveri variant");
+        this->setRMMIO(reinterpret_cast<volatile uint32_t *>(this->rmmio->getVirtualAddress()),
+            static_cast<UInt32>(this->rmmio->getLength()));
+    }
+}
+
+void LRed::setRMMIO(volatile UInt32 *ptr, UInt32 size) {
+    this->rmmioPtr = ptr;
+    this->rmmioSize = size;
+    this->pcieIndirect.init();
+    this->smcIndirect.init();
+    this->mmioStats.init(this->iGPU);
+    this->hangCapture.init(X4000::ringTraceRecordSize());
+
+    UInt32 gartOverrideMB = 0;
+    PE_parse_boot_argn("LRedGARTSize", &gartOverrideMB, sizeof(gartOverrideMB));
+    UInt64 physMemSize = 0;
+    size_t physMemSizeLen = sizeof(physMemSize);
+    if (sysctlbyname("hw.memsize", &physMemSize, &physMemSizeLen, nullptr, 0)) {
+        SYSLOG("LRed", "Failed to get the physical memory size");
+    }
+
+#ifdef DEBUG
+    //! The rejected layouts in there log like real ones would
+    SYSLOG_COND(!GPUAddressSpace::selfTest(), "LRed", "Address space self-test failed");
+#endif
+    this->initFromRegisters(physMemSize, gartOverrideMB);
+
+    this->addressSpace.publish(this->iGPU);
+    this->publishMemoryTopology();
+    if (this->gcn3) { this->smu8.init(); }
+    this->telemetry.init(this->iGPU);
+}
+
+//! Only reads registers, through `rmmioPtr` and the indirect pairs, and the VBIOS, and fills in our state from them.
+//! Everything that needs kernel services (boot-args, sysctl, the IORegistry, thread calls) stays in `setRMMIO`.
+void LRed::initFromRegisters(UInt64 physMemSize, UInt32 gartOverrideMB) {
+    auto fbLocation = this->readReg32(mmMC_VM_FB_LOCATION);
+    auto fbOffset = this->readReg32(mmMC_VM_FB_OFFSET);
+    auto memSize = this->readReg32(mmCONFIG_MEMSIZE);
+    //! Never program the system aperture or hand X4000 a GART from a layout that failed validation
+    this->addressSpace.computeFromReadout(fbLocation, fbOffset, memSize, physMemSize, gartOverrideMB);
+    SYSLOG("LRed", "VRAM: Size %lluMB, Start: 0x%llx, End: 0x%llx, FB offset: 0x%llX, GART size: %lluMB",
+        this->addressSpace.vramSize >> 20, this->addressSpace.vramStart, this->addressSpace.vramEnd,
+        this->addressSpace.fbOffset, this->addressSpace.gartSize >> 20);
+
+    this->probeMemoryTopology();
+
+    this->identifyChip();
+}
+
+void LRed::identifyChip() {
+    this->asic = findASIC(
+        this->deviceId, this->pciRevision,
+        [this](RevisionSource source) -> UInt16 {
+            switch (source) {
+                case RevisionSource::Strap:
+                    return (this->readReg32(0x1559) >> 0x1C) & 0xF;
+                case RevisionSource::SMC:
+                    return (this->smcReadReg32Cz(0xC0014044) >> 9) & 0xF;
+                default:
+                    return 0;
+            }
+        },
+        this->revision);
+    PANIC_COND(!this->asic, "LRed", "Unknown device ID 0x%X revision 0x%X", this->deviceId, this->pciRevision);
+
+    static const char *chipTypeNames[] = {"Spectre", "Spooky", "Kalindi", "Godavari", "Carrizo", "Stoney"};
+    static const char *chipVariantNames[] = {"Kaveri", "Kabini", "Temash", "Bhavani", "Mullins", "Carrizo", "Bristol",
+        "Stoney"};
+    this->familyId = this->asic->familyId;
+    this->chipType = this->asic->chipType;
+    this->chipVariant = this->asic->chipVariant;
+    this->enumeratedRevision = this->asic->enumeratedRevision;
+    this->gcn3 = this->familyId == AMDGPU_FAMILY_CZ;
+    this->stoney = this->chipType == ChipType::Stoney;
+    this->stoney3CU = this->stoney && this->asic->maxCUCount == 3;
+    DBGLOG("LRed", "Chip type %s, %s variant", chipTypeNames[static_cast<int>(this->chipType)],
+        chipVariantNames[static_cast<int>(this->chipVariant)]);
+    DBGLOG_COND(this->stoney, "LRed", "Chip is a %dCU model", this->stoney3CU ? 3 : 2);
+    DBGLOG_COND(this->gcn3, "LRed", "iGPU is GCN 3 derivative");
+    //! Why ChipType instead of ChipVariant? For mullins we set it as 'Godavari', which is technically just
+    //! Kalindi+, by the looks of AMDGPU code
+    //! Very rough guess
+    this->emulatedRevision =
+        (LRed::callback->chipType == ChipType::Kalindi) ?
+            static_cast<uint32_t>(LRed::callback->enumeratedRevision) :
+            static_cast<uint32_t>(LRed::callback->enumeratedRevision) + LRed::callback->revision;
+}
+
+static DMIT17MemType legacyMemTypeToDMI(UInt8 memoryType) {
+    switch (memoryType & 0xF) {
+        case 2:
+            return kDDR2MemType;
+        case 3:
+            return kDDR3MemType;
+        case 4:
+            return kDDR4MemType;
+        default:
+            return kUnknownMemType;
+    }
+}
+
+//! v1.11 and v2 tables already hold an SMBIOS type 17 value, anything we don't know of is treated as unknown
+static DMIT17MemType dmiMemType(UInt8 memoryType) {
+    switch (memoryType) {
+        case kDDR2MemType:
+        case kDDR2FBDIMMMemType:
+        case kDDR3MemType:
+        case kDDR4MemType:
+        case kLPDDR2MemType:
+        case kLPDDR3MemType:
+        case kLPDDR4MemType:
+        case kDDR5MemType:
+        case kLPDDR5MemType:
+            return static_cast<DMIT17MemType>(memoryType);
+        default:
+            return kUnknownMemType;
+    }
+}
+
+static const char *getMemTypeName(DMIT17MemType memoryType) {
+    switch (memoryType) {
+        case kDDR2MemType:
+            return "DDR2";
+        case kDDR3MemType:
+            return "DDR3";
+        case kDDR2FBDIMMMemType:
+            return "DDR2 FB-DIMM";
+        case kDDR4MemType:
+            return "DDR4";
+        case kLPDDR2MemType:
+            return "LPDDR2";
+        case kLPDDR3MemType:
+            return "LPDDR3";
+        case kLPDDR4MemType:
+            return "LPDDR4";
+        case kDDR5MemType:
+            return "DDR5";
+        case kLPDDR5MemType:
+            return "LPDDR5";
+        default:
+            return "Unknown";
+    }
+}
+
+void LRed::probeMemoryTopology() {
+    auto &topology = this->memoryTopology;
+
+    //! MC_VM_FB_LOCATION holds the FB base and top in 16MB units
+    UInt32 fbLocation = this->readReg32(mmMC_VM_FB_LOCATION);
+    UInt64 fbBase = static_cast<UInt64>(fbLocation & 0xFFFF) << 24;
+    UInt64 fbTop = (static_cast<UInt64>(fbLocation >> 16) << 24) | 0xFFFFFF;
+    topology.fbSize = fbTop > fbBase ? (fbTop - fbBase + 1) : 0;
+    topology.consistent = topology.fbSize == this->addressSpace.vramSize;
+    SYSLOG_COND(!topology.consistent, "LRed", "FB aperture size (0x%llx) does not match CONFIG_MEMSIZE (0x%llx)",
+        topology.fbSize, this->addressSpace.vramSize);
+
+    if (!this->vbiosData) {
+        SYSLOG("LRed", "No VBIOS, memory topology unknown");
+        return;
+    }
+    const auto *info = this->getVBIOSDataTable<const IGPSystemInfo>(ATOM_DATA_TABLE_INTEGRATED_SYSTEM_INFO);
+    if (!info) {
+        SYSLOG("LRed", "No IntegratedSystemInfo table, memory topology unknown");
+        return;
+    }
+
+    switch (info->header.formatRev) {
+        case 1:
+            switch (info->header.contentRev) {
+                case 8:
+                case 9:
+                    topology.memoryType = legacyMemTypeToDMI(info->infoV1_8.memoryType);
+                    topology.channelCount = info->infoV1_8.umaChannelNumber;
+                    topology.umaClockMHz = info->infoV1_8.bootUpUMAClock / 100;
                     break;
-                }
-                this->chipType = ChipType::Spectre;
-                this->chipVariant = ChipVariant::Kaveri;
-                this->enumeratedRevision = 0x1;
-                this->revision = (this->readReg32(0x1559) >> 0x1C) & 0xF;
-                DBGLOG("LRed", "Chip type Spectre, Kaveri variant");
-                break;
-            case 0x9830 ... 0x983D:
-                this->familyId = AMDGPU_FAMILY_KV;
-                this->revision = (this->readReg32(0x1559) >> 0x1C) & 0xF;
-                this->chipType = ChipType::Kalindi;
-                switch (this->revision) {
-                    case 0x00:
-                        this->chipVariant = ChipVariant::Kabini;
-                        this->enumeratedRevision = 0x81;
-                        DBGLOG("LRed", "Chip type Kalindi, Kabini variant");
-                        break;
-                    case 0x01:
-                        this->chipVariant = ChipVariant::Kabini;
-                        this->enumeratedRevision = 0x82;
-                        DBGLOG("LRed", "Chip type Kalindi, Kabini variant");
-                        break;
-                    case 0x02:
-                        this->chipVariant = ChipVariant::Bhavani;
-                        this->enumeratedRevision = 0x85;
-                        DBGLOG("LRed", "Chip type Kalindi, Bhavani variant");
-                        break;
-                    default:
-                        PANIC("LRed", "Unknown Kalindi revision ID");
-                }
-                break;
-            case 0x9850 ... 0x9856:
-                this->chipType = ChipType::Godavari;
-                this->chipVariant = ChipVariant::Mullins;
-                this->familyId = AMDGPU_FAMILY_KV;
-                this->enumeratedRevision = 0xA1;
-                this->revision = (this->readReg32(0x1559) >> 0x1C) & 0xF;
-                DBGLOG("LRed", "Chip type Godavari, Mullins variant");
-                break;
-            case 0x9874:
-                this->familyId = AMDGPU_FAMILY_CZ;
-                this->chipType = ChipType::Carrizo;
-                this->gcn3 = true;
-                this->enumeratedRevision = 0x1;
-                this->revision = (smcReadReg32Cz(0xC0014044) >> 9) & 0xF;
-                if ((this->revision >= 0xC8 && this->revision <= 0xCE) ||
-                    (this->revision >= 0xE1 && this->revision <= 0xE6)) {
-                    this->chipVariant = ChipVariant::Bristol;
-                    DBGLOG("LRed", "Chip type Carrizo, Bristol variant");
-                } else {
-                    this->chipVariant = ChipVariant::Carrizo;
-                    DBGLOG("LRed", "Chip type Carrizo, Carrizo variant");
-                }
-                break;
-            case 0x98E4:
-                this->chipType = ChipType::Stoney;
-                this->chipVariant = ChipVariant::Stoney;
-                this->gcn3 = true;
-                this->stoney = true;
-                this->enumeratedRevision = 0x61;
-                this->revision = (smcReadReg32Cz(0xC0014044) >> 9) & 0xF;
-                this->familyId = AMDGPU_FAMILY_CZ;
-                DBGLOG("LRed", "Chip type Stoney, Stoney variant");
-                //! R4 and up iGPUs have 3 compute units while the others have 2 CUs, hence the chip variations
-                this->stoney3CU = this->pciRevision <= 0x81 ||
-                                  (this->pciRevision >= 0xC0 && this->pciRevision < 0xD0) ||
-                                  (this->pciRevision >= 0xD9 && this->pciRevision < 0xDB) || this->pciRevision >= 0xE9;
-                DBGLOG("LRed", "Chip is a %dCU model", this->stoney3CU ? 3 : 2);
-                break;
-            default:
-                PANIC("LRed", "Unknown device ID 0x%X", deviceId);
-        }
-        DBGLOG_COND(this->gcn3, "LRed", "iGPU is GCN 3 derivative");
-        //! Why ChipType instead of ChipVariant? For mullins we set it as 'Godavari', which is technically just
-        //! Kalindi+, by the looks of AMDGPU code
-        //! Very rough guess
-        this->emulatedRevision =
-            (LRed::callback->chipType == ChipType::Kalindi) ?
-                static_cast<uint32_t>(LRed::callback->enumeratedRevision) :
-                static_cast<uint32_t>(LRed::callback->enumeratedRevision) + LRed::callback->revision;
+                case 11:
+                    topology.memoryType = dmiMemType(info->infoV11.memoryType);
+                    topology.channelCount = info->infoV11.umaChannelCount;
+                    break;
+                default:
+                    SYSLOG("LRed", "Unsupported IntegratedSystemInfo v1.%d", info->header.contentRev);
+                    return;
+            }
+            break;
+        case 2:
+            topology.memoryType = dmiMemType(info->infoV2.memoryType);
+            topology.channelCount = info->infoV2.umaChannelCount;
+            break;
+        default:
+            SYSLOG("LRed", "Unsupported IntegratedSystemInfo v%d.%d", info->header.formatRev,
+                info->header.contentRev);
+            return;
     }
+
+    //! Some VBIOSes leave the channel count zeroed out; every supported APU has at least one 64-bit channel
+    if (!topology.channelCount) {
+        SYSLOG("LRed", "VBIOS reports no UMA channels, assuming one");
+        topology.channelCount = 1;
+    }
+
+    //! v1.11 and v2 have no UMA clock, and some v1.8 VBIOSes leave it zeroed out; fall back to the boot memory clock
+    if (!topology.umaClockMHz) {
+        const auto *fwInfo = this->getVBIOSDataTable<const ATOMFirmwareInfo>(ATOM_DATA_TABLE_FIRMWARE_INFO);
+        if (fwInfo) { topology.umaClockMHz = fwInfo->bootUpMemoryClock / 100; }
+        SYSLOG_COND(!topology.umaClockMHz, "LRed", "VBIOS reports no memory clock, peak bandwidth unknown");
+    }
+
+    //! 64-bit channels, double data rate
+    topology.peakBandwidthMBps = topology.channelCount * 8 * topology.umaClockMHz * 2;
+
+    DBGLOG("LRed", "Memory: %s, %u channel(s), %uMHz, ~%uMB/s peak", getMemTypeName(topology.memoryType),
+        topology.channelCount, topology.umaClockMHz, topology.peakBandwidthMBps);
+}
+
+void LRed::publishMemoryTopology() {
+    const auto &topology = this->memoryTopology;
+    auto *dict = OSDictionary::withCapacity(6);
+    if (!dict) { return; }
+    auto *type = OSString::withCString(getMemTypeName(topology.memoryType));
+    if (type) {
+        dict->setObject("Type", type);
+        type->release();
+    }
+    const struct {
+        const char *name;
+        UInt64 value;
+    } numbers[] = {
+        {"Channels", topology.channelCount},
+        {"UMAClockMHz", topology.umaClockMHz},
+        {"PeakBandwidthMBps", topology.peakBandwidthMBps},
+        {"FBApertureSize", topology.fbSize},
+        {"CarveoutSize", this->addressSpace.vramSize},
+    };
+    for (auto &entry : numbers) {
+        //! Zero means unknown, leave it out instead of publishing a bogus figure
+        if (!entry.value) { continue; }
+        auto *num = OSNumber::withNumber(entry.value, 64);
+        if (!num) { continue; }
+        dict->setObject(entry.name, num);
+        num->release();
+    }
+    dict->setObject("Consistent", topology.consistent ? kOSBooleanTrue : kOSBooleanFalse);
+    this->iGPU->setProperty("LRed Memory Topology", dict);
+    dict->release();
 }
 
 void LRed::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size) {
@@ -369,7 +516,4 @@ bool LRed::wrapApplePanelSetDisplay(IOService *that, IODisplay *display) {
     return result;
 }
 
-void LRed::signalFBDumpDeviceInfo() { 
-    fb.dumpAllFramebuffers();
-    fb.fbDumpDevProps();
-}
+void LRed::signalFBDumpDeviceInfo() { fb.signalDump(); }
@@ -3,35 +3,41 @@
 
 #pragma once
 #include "AMDCommon.hpp"
+#include "ASICTable.hpp"
+#include "AddressSpace.hpp"
 #include "ATOMBIOS.hpp"
+#include "DisplayObjects.hpp"
 #include "Firmware.hpp"
+#include "HangCapture.hpp"
+#include "IndirectRegs.hpp"
+#include "MMIOStats.hpp"
+#include "SMU8.hpp"
+#include "Telemetry.hpp"
 #include <Headers/kern_iokit.hpp>
 #include <IOKit/acpi/IOACPIPlatformExpert.h>
 #include <IOKit/graphics/IOFramebuffer.h>
 #include <IOKit/pci/IOPCIDevice.h>
 
-//! GFX core codenames
-enum struct ChipType : UInt32 {
-    Spectre = 0,    //! Kaveri
-    Spooky,         //! Kaveri 2? downgraded from Spectre core
-    Kalindi,        //! Kabini/Bhavani
-    Godavari,       //! Mullins
-    Carrizo,
-    Stoney,
-    Unknown,
+//! System memory as seen by the iGPU, derived from IntegratedSystemInfo and cross-checked against the MC
+struct MemoryTopology {
+    DMIT17MemType memoryType {kUnknownMemType};
+    UInt8 channelCount {0};
+    UInt32 umaClockMHz {0};
+    UInt32 peakBandwidthMBps {0};
+    UInt64 fbSize {0};
+    bool consistent {false};
 };
 
-//! Front-end consumer names, includes non-consumer names as-well
-enum struct ChipVariant : UInt32 {
-    Kaveri = 0,
-    Kabini,
-    Temash,
-    Bhavani,
-    Mullins,
-    Carrizo,
-    Bristol,    //! Bristol is actually just a Carrizo+, hence why it isn't in ChipType
-    Stoney,
-    Unknown,
+//! Registers only LRed programs, served from a write-through shadow by `readReg32Cached`.
+//! Anything X4000, CAIL or the interrupt manager also write (e.g. the IH control registers) must not be listed here.
+static constexpr UInt32 shadowedRegs[] = {
+    mmMC_VM_SYSTEM_APERTURE_LOW_ADDR,
+    mmMC_VM_SYSTEM_APERTURE_HIGH_ADDR,
+    mmMC_VM_SYSTEM_APERTURE_DEFAULT_ADDR,
+    mmVM_CONTEXT0_PROTECTION_FAULT_DEFAULT_ADDR,
+    mmMC_VM_AGP_BASE,
+    mmMC_VM_AGP_TOP,
+    mmMC_VM_AGP_BOT,
 };
 
 //! Hack
@@ -78,6 +84,11 @@ class LRed {
     friend class X4000;
     friend class Support;
     friend class DYLDPatches;
+    friend class RegBatch;
+    friend class HangCapture;
+    friend class SMU8;
+    friend class Telemetry;
+    friend class IHStats;
 
     public:
     static LRed *callback;
@@ -86,23 +97,22 @@ class LRed {
     void processPatcher(KernelPatcher &patcher);
     void processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size);
     void setRMMIOIfNecessary();
+    void setRMMIO(volatile UInt32 *ptr, UInt32 size);
+    void initFromRegisters(UInt64 physMemSize, UInt32 gartOverrideMB);
+    void identifyChip();
+    void probeMemoryTopology();
+    void publishMemoryTopology();
     void signalFBDumpDeviceInfo();
 
     private:
-    //! Why not inject VCE & UVD firmware on Godavari and lower ASICs?
-    //! Because the firmware is the exact same.
-    //! I'm serious, they use the same binary.
     static const char *getVCEPrefix() {
-        PANIC_COND(callback->chipType == ChipType::Unknown, "LRed", "Unknown chip type");
-        static const char *vcePrefix[] = {"ativce02", "ativce02", "ativce02", "ativce02", "amde31a", "amde34a"};
-        return vcePrefix[static_cast<int>(callback->chipType)];
+        PANIC_COND(!callback->asic, "LRed", "Unknown chip type");
+        return callback->asic->vcePrefix;
     }
 
     static const char *getUVDPrefix() {
-        PANIC_COND(callback->chipType == ChipType::Unknown, "LRed", "Unknown chip type");
-        static const char *uvdPrefix[] = {"ativvaxy_cik", "ativvaxy_cik", "ativvaxy_cik", "ativvaxy_cik", "ativvaxy_cz",
-            "ativvaxy_stn"};
-        return uvdPrefix[static_cast<int>(callback->chipType)];
+        PANIC_COND(!callback->asic, "LRed", "Unknown chip type");
+        return callback->asic->uvdPrefix;
     }
 
     bool getVBIOSFromVFCT(IOPCIDevice *obj) {
@@ -178,51 +188,105 @@ class LRed {
     }
 
     UInt32 readReg32(UInt32 reg) {
-        if ((reg * 4) < this->rmmio->getLength()) { return this->rmmioPtr[reg]; }
-
-        this->rmmioPtr[mmPCIE_INDEX_2] = reg;
-        return this->rmmioPtr[mmPCIE_DATA_2];
+        MMIO_STATS_SCOPE(this->mmioStats, Read, reg);
+        if ((reg * 4) < this->rmmioSize) { return this->rmmioPtr[reg]; }
+        return this->pcieIndirect.read(this->rmmioPtr, reg);
     }
 
     void writeReg32(UInt32 reg, UInt32 val) {
-        if ((reg * 4) < this->rmmio->getLength()) {
+        MMIO_STATS_SCOPE(this->mmioStats, Write, reg);
+        if ((reg * 4) < this->rmmioSize) {
             this->rmmioPtr[reg] = val;
         } else {
-            this->rmmioPtr[mmPCIE_INDEX_2] = reg;
-            this->rmmioPtr[mmPCIE_DATA_2] = val;
+            this->pcieIndirect.write(this->rmmioPtr, reg, val);
+        }
+    }
+
+    //! Writes a register and keeps its shadow up to date, plain `writeReg32` doesn't touch the shadow
+    void writeReg32Shadowed(UInt32 reg, UInt32 val) {
+        this->writeReg32(reg, val);
+        this->updateRegShadow(reg, val);
+    }
+
+    static int getRegShadowIndex(UInt32 reg) {
+        for (size_t i = 0; i < arrsize(shadowedRegs); i++) {
+            if (shadowedRegs[i] == reg) { return static_cast<int>(i); }
         }
+        return -1;
+    }
+
+    //! Same as `readReg32`, but registers we own are only read from the hardware once
+    UInt32 readReg32Cached(UInt32 reg) {
+        auto i = getRegShadowIndex(reg);
+        if (i < 0) { return this->readReg32(reg); }
+        if (!(this->regShadowValid & (1U << i))) {
+            this->regShadow[i] = this->readReg32(reg);
+            this->regShadowValid |= (1U << i);
+        }
+        return this->regShadow[i];
+    }
+
+    void updateRegShadow(UInt32 reg, UInt32 val) {
+        auto i = getRegShadowIndex(reg);
+        if (i < 0) { return; }
+        this->regShadow[i] = val;
+        this->regShadowValid |= (1U << i);
     }
 
     UInt32 smcReadReg32Cz(UInt32 reg) {
-        this->writeReg32(mmMP0PUB_IND_INDEX, reg);
-        return this->readReg32(mmMP0PUB_IND_DATA);
+        MMIO_STATS_SCOPE(this->mmioStats, SMCRead, reg);
+        return this->smcIndirect.read(this->rmmioPtr, reg);
     }
 
-    template<typename T>
-    T *getVBIOSDataTable(UInt32 index) {
+    UInt16 getVBIOSDataTableOffset(UInt32 index) {
         const auto *vbios = static_cast<const uint8_t *>(this->vbiosData->getBytesNoCopy());
         const auto base = *reinterpret_cast<const uint16_t *>(vbios + ATOM_ROM_TABLE_PTR);
         const auto dataTable = *reinterpret_cast<const uint16_t *>(vbios + base + ATOM_ROM_DATA_PTR);
         const auto *mdt = reinterpret_cast<const uint16_t *>(vbios + dataTable + 4);
+        return mdt[index];
+    }
 
-        if (mdt[index]) {
-            const UInt32 offset = index * 2 + 4;
-            const auto index = *reinterpret_cast<const uint16_t *>(vbios + dataTable + offset);
-            return reinterpret_cast<T *>(const_cast<uint8_t *>(vbios) + index);
-        }
+    template<typename T>
+    T *getVBIOSDataTable(UInt32 index) {
+        const auto offset = this->getVBIOSDataTableOffset(index);
+        if (!offset) { return nullptr; }
+        const auto *vbios = static_cast<const uint8_t *>(this->vbiosData->getBytesNoCopy());
+        return reinterpret_cast<T *>(const_cast<uint8_t *>(vbios) + offset);
+    }
 
-        return nullptr;
+    void parseDisplayObjects() {
+        const auto offset = this->getVBIOSDataTableOffset(ATOM_DATA_TABLE_OBJECT_HEADER);
+        if (!offset) {
+            DBGLOG("LRed", "VBIOS has no object header");
+            return;
+        }
+        const auto *vbios = static_cast<const uint8_t *>(this->vbiosData->getBytesNoCopy());
+        if (this->displayObjects.parse(vbios, this->vbiosData->getLength(), offset)) {
+            this->displayObjects.publish(this->iGPU);
+        } else {
+            SYSLOG("LRed", "Failed to parse VBIOS display objects");
+        }
     }
 
     OSData *vbiosData {nullptr};
+    DisplayObjectGraph displayObjects;
+    const ASICDescriptor *asic {nullptr};
     ChipType chipType {ChipType::Unknown};
     ChipVariant chipVariant {ChipVariant::Unknown};
     bool gcn3 {false};
     bool stoney3CU {false};
     bool stoney {false};
-    UInt64 fbOffset {0};
     IOMemoryMap *rmmio {nullptr};
     volatile UInt32 *rmmioPtr {nullptr};
+    UInt32 rmmioSize {0};
+    IndirectRegPair pcieIndirect {mmPCIE_INDEX_2, mmPCIE_DATA_2};
+    IndirectRegPair smcIndirect {mmMP0PUB_IND_INDEX, mmMP0PUB_IND_DATA};
+    MMIOStats mmioStats;
+    HangCapture hangCapture;
+    SMU8 smu8;
+    Telemetry telemetry;
+    UInt32 regShadow[arrsize(shadowedRegs)] {};
+    UInt32 regShadowValid {0};
     UInt32 deviceId {0};
     UInt16 enumeratedRevision {0};
     UInt16 revision {0};
@@ -230,10 +294,8 @@ class LRed {
     UInt32 familyId {0};
     UInt32 emulatedRevision {0};
     IOPCIDevice *iGPU {nullptr};
-    UInt64 vramStart {0};
-    UInt64 vramEnd {0};
-    UInt64 mcLocation {0};
-    UInt64 memSize {0};
+    GPUAddressSpace addressSpace;
+    MemoryTopology memoryTopology;
 
     mach_vm_address_t orgApplePanelSetDisplay {0};
 
@@ -0,0 +1,98 @@
+//! Copyright © 2024 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.5.
+//! See LICENSE for details.
+
+#include "MMIOStats.hpp"
+
+#if LRED_MMIO_STATS
+void MMIOStats::init(IOService *provider) {
+    if (this->buckets || !checkKernelArgument("-LRedMMIOStats")) { return; }
+
+    this->provider = provider;
+    this->publishCall = thread_call_allocate(publishTimer, this);
+    if (!this->publishCall) {
+        SYSLOG("MMIOStats", "Failed to allocate publish thread call");
+        return;
+    }
+    clock_interval_to_absolutetime_interval(MMIO_STATS_PUBLISH_INTERVAL_MS, kMillisecondScale,
+        &this->publishInterval);
+    this->buckets = new MMIOStatsBucket[MMIO_STATS_CPU_BUCKETS]();
+    thread_call_enter_delayed(this->publishCall, mach_absolute_time() + this->publishInterval);
+    DBGLOG("MMIOStats", "Collecting MMIO statistics");
+}
+
+void MMIOStats::publishTimer(thread_call_param_t param0, thread_call_param_t) {
+    auto *that = static_cast<MMIOStats *>(param0);
+    that->publish();
+    thread_call_enter_delayed(that->publishCall, mach_absolute_time() + that->publishInterval);
+}
+
+static void addRegCount(OSDictionary *regs, UInt32 reg, const UInt32 *counts) {
+    static const char *kindNames[] = {"Reads", "Writes", "SMC Reads"};
+    char name[12];
+    snprintf(name, sizeof(name), "0x%X", reg);
+    auto *entry = OSDynamicCast(OSDictionary, regs->getObject(name));
+    bool created = !entry;
+    if (created) { entry = OSDictionary::withCapacity(arrsize(kindNames)); }
+    if (!entry) { return; }
+    for (size_t k = 0; k < arrsize(kindNames); k++) {
+        auto *prev = OSDynamicCast(OSNumber, entry->getObject(kindNames[k]));
+        auto *num = OSNumber::withNumber((prev ? prev->unsigned64BitValue() : 0) + counts[k], 64);
+        if (!num) { continue; }
+        entry->setObject(kindNames[k], num);
+        num->release();
+    }
+    if (created) {
+        regs->setObject(name, entry);
+        entry->release();
+    }
+}
+
+void MMIOStats::publish() {
+    if (!this->buckets) { return; }
+
+    static const char *histNames[] = {"Read Latency Log2", "Write Latency Log2", "SMC Read Latency Log2"};
+    UInt64 histogram[static_cast<size_t>(MMIOAccess::Count)][MMIO_STATS_HIST_BINS] {};
+    UInt64 droppedRegs = 0;
+    auto *regs = OSDictionary::withCapacity(MMIO_STATS_REG_SLOTS);
+    auto *dict = OSDictionary::withCapacity(arrsize(histNames) + 2);
+    if (!regs || !dict) {
+        OSSafeReleaseNULL(regs);
+        OSSafeReleaseNULL(dict);
+        return;
+    }
+
+    for (size_t cpu = 0; cpu < MMIO_STATS_CPU_BUCKETS; cpu++) {
+        auto &bucket = this->buckets[cpu];
+        for (size_t k = 0; k < static_cast<size_t>(MMIOAccess::Count); k++) {
+            for (size_t bin = 0; bin < MMIO_STATS_HIST_BINS; bin++) { histogram[k][bin] += bucket.histogram[k][bin]; }
+        }
+        for (size_t slot = 0; slot < MMIO_STATS_REG_SLOTS; slot++) {
+            if (bucket.regs[slot]) { addRegCount(regs, bucket.regs[slot] - 1, bucket.regCounts[slot]); }
+        }
+        droppedRegs += bucket.droppedRegs;
+    }
+
+    for (size_t k = 0; k < arrsize(histNames); k++) {
+        auto *bins = OSArray::withCapacity(MMIO_STATS_HIST_BINS);
+        if (!bins) { continue; }
+        for (size_t bin = 0; bin < MMIO_STATS_HIST_BINS; bin++) {
+            auto *num = OSNumber::withNumber(histogram[k][bin], 64);
+            if (!num) { continue; }
+            bins->setObject(num);
+            num->release();
+        }
+        dict->setObject(histNames[k], bins);
+        bins->release();
+    }
+    dict->setObject("Registers", regs);
+    regs->release();
+    auto *dropped = OSNumber::withNumber(droppedRegs, 64);
+    if (dropped) {
+        dict->setObject("Untracked Register Accesses", dropped);
+        dropped->release();
+    }
+
+    this->provider->setProperty("LRed MMIO Stats", dict);
+    dict->release();
+}
+#endif
@@ -0,0 +1,109 @@
+//! Copyright © 2024 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.5.
+//! See LICENSE for details.
+
+#pragma once
+#include <Headers/kern_util.hpp>
+#include <IOKit/IOService.h>
+
+//! Per-register access counters and a log2 latency histogram for the LRed register accessors.
+//! Compiled out unless built with `LRED_MMIO_STATS=1` (the Debug and Sanitize configurations define it),
+//! and even then only collected with `-LRedMMIOStats`.
+#ifndef LRED_MMIO_STATS
+#define LRED_MMIO_STATS 0
+#endif
+
+#if LRED_MMIO_STATS
+#include <kern/clock.h>
+#include <kern/cpu_number.h>
+#include <kern/thread_call.h>
+#include <libkern/OSAtomic.h>
+
+enum struct MMIOAccess : UInt32 {
+    Read = 0,
+    Write,
+    SMCRead,
+    Count,
+};
+
+constexpr size_t MMIO_STATS_CPU_BUCKETS = 16;
+constexpr size_t MMIO_STATS_REG_SLOTS = 64;
+constexpr size_t MMIO_STATS_REG_PROBES = 4;
+constexpr size_t MMIO_STATS_HIST_BINS = 32;
+constexpr UInt32 MMIO_STATS_PUBLISH_INTERVAL_MS = 5000;
+
+//! Counters are bumped without atomics; a thread migrating mid-update may lose a count, which is fine for profiling.
+struct MMIOStatsBucket {
+    UInt32 regs[MMIO_STATS_REG_SLOTS];    //! Register + 1, 0 = empty slot
+    UInt32 regCounts[MMIO_STATS_REG_SLOTS][static_cast<size_t>(MMIOAccess::Count)];
+    UInt32 droppedRegs;
+    //! Bin N counts accesses which took [2^(N-1), 2^N) `mach_absolute_time` ticks, bin 0 is 0 ticks
+    UInt32 histogram[static_cast<size_t>(MMIOAccess::Count)][MMIO_STATS_HIST_BINS];
+};
+
+static inline size_t mmioStatsHistBin(UInt64 delta) {
+    if (!delta) { return 0; }
+    size_t bin = 64 - __builtin_clzll(delta);
+    return bin < MMIO_STATS_HIST_BINS ? bin : MMIO_STATS_HIST_BINS - 1;
+}
+
+class MMIOStats {
+    MMIOStatsBucket *buckets {nullptr};
+    IOService *provider {nullptr};
+    thread_call_t publishCall {nullptr};
+    uint64_t publishInterval {0};
+
+    static void publishTimer(thread_call_param_t param0, thread_call_param_t param1);
+
+    public:
+    void init(IOService *provider);
+    void publish();
+
+    bool enabled() const { return this->buckets != nullptr; }
+
+    void record(MMIOAccess kind, UInt32 reg, UInt64 start) {
+        auto delta = mach_absolute_time() - start;
+        auto &bucket = this->buckets[static_cast<size_t>(cpu_number()) % MMIO_STATS_CPU_BUCKETS];
+        auto k = static_cast<size_t>(kind);
+        bucket.histogram[k][mmioStatsHistBin(delta)]++;
+
+        size_t slot = (reg * 2654435761U) % MMIO_STATS_REG_SLOTS;
+        for (size_t i = 0; i < MMIO_STATS_REG_PROBES; i++, slot = (slot + 1) % MMIO_STATS_REG_SLOTS) {
+            //! Another CPU can't be using this bucket's slots unless the thread migrated, but be safe anyway
+            if (!bucket.regs[slot]) { OSCompareAndSwap(0, reg + 1, &bucket.regs[slot]); }
+            if (bucket.regs[slot] == reg + 1) {
+                bucket.regCounts[slot][k]++;
+                return;
+            }
+        }
+        bucket.droppedRegs++;
+    }
+};
+
+//! Times the enclosing scope and records it against `reg`
+class MMIOStatsScope {
+    MMIOStats &stats;
+    MMIOAccess kind;
+    UInt32 reg;
+    UInt64 start {0};
+
+    public:
+    MMIOStatsScope(MMIOStats &stats, MMIOAccess kind, UInt32 reg) : stats {stats}, kind {kind}, reg {reg} {
+        if (stats.enabled()) { this->start = mach_absolute_time(); }
+    }
+
+    ~MMIOStatsScope() {
+        if (this->start) { this->stats.record(this->kind, this->reg, this->start); }
+    }
+};
+
+#define MMIO_STATS_SCOPE(stats, kind, reg) MMIOStatsScope _mmioStatsScope {stats, MMIOAccess::kind, reg}
+#else
+class MMIOStats {
+    public:
+    void init(IOService *) {}
+};
+
+#define MMIO_STATS_SCOPE(stats, kind, reg) \
+    do {                                   \
+    } while (0)
+#endif
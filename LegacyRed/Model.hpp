@@ -275,7 +275,8 @@ static constexpr DevicePair devices[] = {
     {0x98E4, dev98E4, arrsize(dev98E4)},
 };
 
-inline const char *getBranding(UInt16 dev, UInt16 rev) {
+//! `fallback` is the generic name from the ASIC table, used when no specific model is known
+inline const char *getBranding(UInt16 dev, UInt16 rev, const char *fallback) {
     for (auto &device : devices) {
         if (device.dev == dev) {
             for (size_t i = 0; i < device.modelNum; i++) {
@@ -286,14 +287,7 @@ inline const char *getBranding(UInt16 dev, UInt16 rev) {
         }
     }
 
-    switch (dev) {
-        case 0x9830 ... 0x9839:
-            [[fallthrough]];
-        case 0x983D:
-            return "AMD Radeon HD 8XXX";
-        default:
-            return "AMD Radeon R Graphics";
-    }
+    return fallback;
 }
 
 #endif /* kern_model_hpp */
@@ -0,0 +1,71 @@
+//! Copyright © 2024 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.5.
+//! See LICENSE for details.
+
+#pragma once
+#include "LRed.hpp"
+#include <Headers/kern_util.hpp>
+
+constexpr size_t MAX_REG_BATCH_OPS = 16;
+
+//! Collects read-modify-writes and applies them with at most one read and one write per register.
+//! Reads of registers in `shadowedRegs` are served from the shadow, so those usually cost no read at all.
+class RegBatch {
+    struct Op {
+        UInt32 reg;
+        UInt32 clear;
+        UInt32 set;
+        UInt32 value;
+        bool loaded;
+    };
+
+    LRed *lred;
+    Op ops[MAX_REG_BATCH_OPS] {};
+    size_t count {0};
+
+    Op &getOp(UInt32 reg) {
+        for (size_t i = 0; i < this->count; i++) {
+            if (this->ops[i].reg == reg) { return this->ops[i]; }
+        }
+        PANIC_COND(this->count == MAX_REG_BATCH_OPS, "RegBatch", "Too many registers in one batch");
+        auto &op = this->ops[this->count++];
+        op = {reg, 0, 0, 0, false};
+        return op;
+    }
+
+    public:
+    explicit RegBatch(LRed *lred) : lred {lred} {}
+
+    ~RegBatch() { PANIC_COND(this->count, "RegBatch", "Batch destroyed without committing"); }
+
+    //! Value the register will have once the batch is committed
+    UInt32 peek(UInt32 reg) {
+        auto &op = this->getOp(reg);
+        if (!op.loaded && op.clear != 0xFFFFFFFF) {
+            op.value = this->lred->readReg32Cached(reg);
+            op.loaded = true;
+        }
+        return (op.value & ~op.clear) | op.set;
+    }
+
+    void rmw(UInt32 reg, UInt32 clear, UInt32 set) {
+        auto &op = this->getOp(reg);
+        op.clear |= clear;
+        op.set = (op.set & ~clear) | set;
+    }
+
+    void write(UInt32 reg, UInt32 val) { this->rmw(reg, 0xFFFFFFFF, val); }
+
+    template<typename F>
+    void setField(UInt32 value) {
+        this->rmw(F::reg(), F::mask(), F::encode(value));
+    }
+
+    void commit() {
+        for (size_t i = 0; i < this->count; i++) {
+            auto &op = this->ops[i];
+            if (!op.loaded && op.clear != 0xFFFFFFFF) { op.value = this->lred->readReg32Cached(op.reg); }
+            this->lred->writeReg32Shadowed(op.reg, (op.value & ~op.clear) | op.set);
+        }
+        this->count = 0;
+    }
+};
@@ -0,0 +1,133 @@
+//! Copyright © 2024 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.5.
+//! See LICENSE for details.
+
+#include "SMU8.hpp"
+#include "LRed.hpp"
+#include <libkern/OSAtomic.h>
+
+static const char *getPerfProfileName(PerfProfile profile) {
+    switch (profile) {
+        case PerfProfile::Auto:
+            return "Auto";
+        case PerfProfile::Peak:
+            return "Peak";
+        case PerfProfile::Battery:
+            return "Battery";
+        default:
+            return "Unknown";
+    }
+}
+
+void SMU8::init() {
+    if (this->lock) { return; }
+    this->lock = IOLockAlloc();
+    PANIC_COND(!this->lock, "SMU8", "Failed to allocate lock");
+
+    UInt32 profile = 0;
+    if (PE_parse_boot_argn("LRedPerfProfile", &profile, sizeof(profile))) {
+        if (profile > static_cast<UInt32>(PerfProfile::Battery)) {
+            SYSLOG("SMU8", "Invalid performance profile %u, using Auto", profile);
+        } else {
+            this->profile = static_cast<PerfProfile>(profile);
+        }
+    }
+    PE_parse_boot_argn("LRedSclkLevel", &this->sclkLevel, sizeof(this->sclkLevel));
+}
+
+bool SMU8::waitForResponse(UInt32 &response) {
+    for (UInt32 i = 0; i < AMDGPU_MAX_USEC_TIMEOUT; i++) {
+        response = LRed::callback->readReg32(mmSMU_MP1_SRBM2P_RESP_0);
+        if (response) { return true; }
+        IODelay(1);
+    }
+    return false;
+}
+
+SMU8Result SMU8::sendMessage(SMU8Message msg, UInt32 arg) {
+    IOLockLock(this->lock);
+    this->lastMessage = static_cast<UInt32>(msg);
+
+    //! The previous message, ours or PowerPlay's, must have been answered first
+    UInt32 response = 0;
+    if (!this->waitForResponse(response)) {
+        SYSLOG("SMU8", "SMU busy, not sending message 0x%X", this->lastMessage);
+        this->timeouts++;
+        this->lastResult = SMU8Result::Timeout;
+        IOLockUnlock(this->lock);
+        return SMU8Result::Timeout;
+    }
+
+    LRed::callback->writeReg32(mmSMU_MP1_SRBM2P_RESP_0, 0);
+    LRed::callback->writeReg32(mmSMU_MP1_SRBM2P_ARG_0, arg);
+    LRed::callback->writeReg32(mmSMU_MP1_SRBM2P_MSG_0, this->lastMessage);
+
+    auto result = SMU8Result::Timeout;
+    if (this->waitForResponse(response)) {
+        result = static_cast<SMU8Result>(response);
+    } else {
+        this->timeouts++;
+    }
+    if (result != SMU8Result::OK) {
+        SYSLOG("SMU8", "Message 0x%X (arg 0x%X) failed: 0x%X", this->lastMessage, arg, static_cast<UInt32>(result));
+        this->failures++;
+    }
+    this->lastResult = result;
+    IOLockUnlock(this->lock);
+    return result;
+}
+
+SMU8Result SMU8::forceSclkLevel(UInt32 level) {
+    auto result = this->sendMessage(SMU8Message::SetSclkSoftMin, level);
+    if (result != SMU8Result::OK) { return result; }
+    return this->sendMessage(SMU8Message::SetSclkSoftMax, level);
+}
+
+void SMU8::applyProfile() {
+    if (!OSCompareAndSwap(0, 1, &this->applied)) { return; }
+    DBGLOG("SMU8", "Applying %s profile, SCLK level %d", getPerfProfileName(this->profile),
+        static_cast<int>(this->sclkLevel));
+    switch (this->profile) {
+        case PerfProfile::Auto:
+            break;
+        case PerfProfile::Peak:
+            if (this->sendMessage(SMU8Message::MaximizePerf) != SMU8Result::OK) { break; }
+            if (this->sclkLevel != SMU8_NO_SCLK_LEVEL && this->setSclkHardMin(this->sclkLevel) == SMU8Result::OK) {
+                this->forceSclkLevel(this->sclkLevel);
+            }
+            break;
+        case PerfProfile::Battery:
+            if (this->sendMessage(SMU8Message::OptimizeBattery) != SMU8Result::OK) { break; }
+            if (this->sclkLevel != SMU8_NO_SCLK_LEVEL) {
+                this->sendMessage(SMU8Message::SetSclkSoftMax, this->sclkLevel);
+            }
+            break;
+    }
+}
+
+void SMU8::publish(IOService *service) const {
+    auto *dict = OSDictionary::withCapacity(6);
+    if (!dict) { return; }
+    auto *profile = OSString::withCString(getPerfProfileName(this->profile));
+    if (profile) {
+        dict->setObject("Profile", profile);
+        profile->release();
+    }
+    const struct {
+        const char *name;
+        UInt64 value;
+    } numbers[] = {
+        {"SclkLevel", this->sclkLevel},
+        {"LastMessage", this->lastMessage},
+        {"LastResult", static_cast<UInt32>(this->lastResult)},
+        {"Timeouts", this->timeouts},
+        {"Failures", this->failures},
+    };
+    for (auto &entry : numbers) {
+        auto *num = OSNumber::withNumber(entry.value, 64);
+        if (!num) { continue; }
+        dict->setObject(entry.name, num);
+        num->release();
+    }
+    service->setProperty("LRed SMU", dict);
+    dict->release();
+}
@@ -0,0 +1,72 @@
+//! Copyright © 2024 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.5.
+//! See LICENSE for details.
+
+#pragma once
+#include "AMDCommon.hpp"
+#include <Headers/kern_util.hpp>
+#include <IOKit/IOLib.h>
+#include <IOKit/IOService.h>
+
+//! Subset of `PPSMC_Msg` from AMDGPU's smu8 `cz_ppsmc.h`
+enum struct SMU8Message : UInt32 {
+    Test = 0x01,
+    GetFeatureStatus = 0x02,
+    EnableAllSmuFeatures = 0x03,
+    DisableAllSmuFeatures = 0x04,
+    OptimizeBattery = 0x05,
+    MaximizePerf = 0x06,
+    SetSclkSoftMin = 0x12,
+    SetSclkSoftMax = 0x13,
+    SetSclkHardMin = 0x14,
+    SetSclkHardMax = 0x15,
+};
+
+//! `PPSMC_Result`, `Timeout` is ours; the SMU never leaves the response register at 0 once done
+enum struct SMU8Result : UInt32 {
+    Timeout = 0x00,
+    OK = 0x01,
+    CmdRejectedBusy = 0xFC,
+    CmdRejectedPrereq = 0xFD,
+    UnknownCmd = 0xFE,
+    Failed = 0xFF,
+};
+
+//! Selected with the `LRedPerfProfile` boot-arg
+enum struct PerfProfile : UInt32 {
+    Auto = 0,    //! Leave the SMU to AMD's PowerPlay
+    Peak,        //! Maximise performance, pinned to `LRedSclkLevel` if given
+    Battery,     //! Optimise for battery, capped to `LRedSclkLevel` if given (default: no cap)
+};
+
+constexpr UInt32 SMU8_NO_SCLK_LEVEL = 0xFFFFFFFF;
+
+//! Carrizo/Stoney SMU mailbox 0: argument in SMU_MP1_SRBM2P_ARG_0, message in MSG_0, response in RESP_0.
+//! Our own messages are serialised by the lock; AMD's PowerPlay talks to the same mailbox without it, so only
+//! send messages at points where PowerPlay isn't, i.e. once the accelerator has started and PowerPlay has started DPM
+//! and programmed its own SCLK limits, which would otherwise override ours.
+class SMU8 {
+    IOLock *lock {nullptr};
+    PerfProfile profile {PerfProfile::Auto};
+    UInt32 sclkLevel {SMU8_NO_SCLK_LEVEL};
+    UInt32 lastMessage {0};
+    SMU8Result lastResult {SMU8Result::OK};
+    UInt32 timeouts {0};
+    UInt32 failures {0};
+    volatile UInt32 applied {0};
+
+    bool waitForResponse(UInt32 &response);
+
+    public:
+    void init();
+    SMU8Result sendMessage(SMU8Message msg, UInt32 arg = 0);
+
+    //! DPM levels are indices into the SCLK DPM table, as in AMDGPU's smu8_hwmgr
+    SMU8Result forceSclkLevel(UInt32 level);
+    SMU8Result setSclkHardMin(UInt32 level) { return this->sendMessage(SMU8Message::SetSclkHardMin, level); }
+    SMU8Result enableFeatures(UInt32 mask) { return this->sendMessage(SMU8Message::EnableAllSmuFeatures, mask); }
+    SMU8Result disableFeatures(UInt32 mask) { return this->sendMessage(SMU8Message::DisableAllSmuFeatures, mask); }
+
+    //! Only the first call does anything
+    void applyProfile();
+    void publish(IOService *service) const;
+};
@@ -15,6 +15,7 @@ Support *Support::callback = nullptr;
 
 void Support::init() {
     callback = this;
+    this->timingCacheLock = IOLockAlloc();
     lilu.onKextLoadForce(&kextRadeonSupport);
 }
 
@@ -85,23 +86,100 @@ IOReturn Support::wrapPopulateDeviceMemory(void *that, UInt32 reg) {
     return kIOReturnSuccess;
 }
 
+//! FNV-1a over the raw timing, a hit is confirmed against the stored copy
+static UInt64 hashTiming(const AGDCDetailedTimingInformation_t &timing) {
+    UInt64 hash = 0xCBF29CE484222325;
+    const auto *bytes = reinterpret_cast<const UInt8 *>(&timing);
+    for (size_t i = 0; i < sizeof(timing); i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3;
+    }
+    return hash ? hash : 1;
+}
+
+bool Support::lookupTiming(AGDCValidateDetailedTiming_t *cmd, UInt64 hash, bool &result) {
+    if (!this->timingCacheLock || cmd->framebufferIndex >= MAX_FRAMEBUFFER_COUNT) { return false; }
+    IOLockLock(this->timingCacheLock);
+    bool hit = false;
+    for (auto &entry : this->timingCache[cmd->framebufferIndex].entries) {
+        if (entry.hash != hash || memcmp(&entry.timing, &cmd->timing, sizeof(entry.timing))) { continue; }
+        //! Mode status is all the original call leaves behind for statuses other than 3, which we don't cache
+        cmd->modeStatus = entry.modeStatus;
+        result = entry.result;
+        hit = true;
+        break;
+    }
+    if (hit) {
+        this->timingCacheHits++;
+    } else {
+        this->timingCacheMisses++;
+    }
+    IOLockUnlock(this->timingCacheLock);
+    return hit;
+}
+
+void Support::storeTiming(const AGDCValidateDetailedTiming_t *cmd, UInt64 hash, bool result) {
+    if (!this->timingCacheLock || cmd->framebufferIndex >= MAX_FRAMEBUFFER_COUNT) { return; }
+    IOLockLock(this->timingCacheLock);
+    auto &cache = this->timingCache[cmd->framebufferIndex];
+    auto &entry = cache.entries[cache.next];
+    cache.next = (cache.next + 1) % AGDC_TIMING_CACHE_ENTRIES;
+    entry.hash = hash;
+    entry.timing = cmd->timing;
+    entry.modeStatus = cmd->modeStatus;
+    entry.result = result;
+    IOLockUnlock(this->timingCacheLock);
+}
+
+void Support::invalidateTimings() {
+    if (!this->timingCacheLock) { return; }
+    IOLockLock(this->timingCacheLock);
+    bzero(this->timingCache, sizeof(this->timingCache));
+    IOLockUnlock(this->timingCacheLock);
+    DBGLOG("Support", "Timing cache invalidated (hits: %u, misses: %u)", this->timingCacheHits,
+        this->timingCacheMisses);
+}
+
 bool Support::wrapNotifyLinkChange(void *atiDeviceControl, kAGDCRegisterLinkControlEvent_t event, void *eventData,
     UInt32 eventFlags) {
     LRed::callback->signalFBDumpDeviceInfo();
+
+    switch (event) {
+        case kAGDCRegisterLinkInsert:
+        case kAGDCRegisterLinkRemove:
+        case kAGDCRegisterLinkChange:
+        case kAGDCRegisterLinkChangeMST:
+            callback->invalidateTimings();
+            break;
+        case kAGDCValidateDetailedTiming: {
+            auto cmd = static_cast<AGDCValidateDetailedTiming_t *>(eventData);
+            auto hash = hashTiming(cmd->timing);
+            bool ret;
+            if (callback->lookupTiming(cmd, hash, ret)) {
+                DBGLOG("Support", "AGDCValidateDetailedTiming %u -> %d (%u) (cached)", cmd->framebufferIndex, ret,
+                    cmd->modeStatus);
+                return ret;
+            }
+            ret = FunctionCast(wrapNotifyLinkChange, callback->orgNotifyLinkChange)(atiDeviceControl, event,
+                eventData, eventFlags);
+            DBGLOG("Support", "AGDCValidateDetailedTiming %u -> %d (%u)", cmd->framebufferIndex, ret, cmd->modeStatus);
+            if (ret == false || cmd->modeStatus < 1 || cmd->modeStatus > 3) {
+                cmd->modeStatus = 2;
+                ret = true;
+            }
+            //! Status 3 comes with an adjusted timing in the command, which the cache doesn't keep
+            if (cmd->modeStatus != 3) { callback->storeTiming(cmd, hash, ret); }
+            return ret;
+        }
+        default:
+            break;
+    }
+
     auto ret = FunctionCast(wrapNotifyLinkChange, callback->orgNotifyLinkChange)(atiDeviceControl, event, eventData,
         eventFlags);
 
     DBGLOG("Support", "FB Link has changed! Event: %d, Data: %p, Flags: 0x%x", event, eventData, eventFlags);
 
-    if (event == kAGDCValidateDetailedTiming) {
-        auto cmd = static_cast<AGDCValidateDetailedTiming_t *>(eventData);
-        DBGLOG("Support", "AGDCValidateDetailedTiming %u -> %d (%u)", cmd->framebufferIndex, ret, cmd->modeStatus);
-        if (ret == false || cmd->modeStatus < 1 || cmd->modeStatus > 3) {
-            cmd->modeStatus = 2;
-            ret = true;
-        }
-    }
-
     return ret;
 }
 
@@ -119,8 +197,10 @@ void *Support::wrapCreateAtomBiosParser(void *that, void *param1, unsigned char
     return ret;
 }
 
-void Support::wrapDoGPUPanic() {
+void Support::wrapDoGPUPanic(void *, const char *fmt) {
     DBGLOG("Support", "doGPUPanic << ()");
+    //! The arguments aren't forwarded, but the format string alone usually says what failed
+    LRed::callback->hangCapture.capture(HangReason::GPUPanic, fmt);
     while (true) { IOSleep(3600000); }
 }
 
@@ -129,6 +209,17 @@ bool Support::wrapObjectInfoTableInit(void *that, void *initdata) {
     struct ATOMObjTable *conInfoTbl = getMember<ATOMObjTable *>(that, 0x38);
     auto n = conInfoTbl->numberOfObjects;
     DBGLOG("Support", "Fixing VBIOS connectors");
+    //! Serve the fixup from the display object graph when AMDSupport parsed the same table we did
+    const auto &graph = LRed::callback->displayObjects;
+    if (graph.matchesConnectorTable(conInfoTbl)) {
+        for (size_t i = 0; i < graph.connectorCount; i++) {
+            conInfoTbl->objects[i] = {graph.connectorIds[i], graph.connectorSrcDstOffsets[i],
+                graph.connectorRecordOffsets[i], 0};
+        }
+        conInfoTbl->numberOfObjects = graph.connectorCount;
+        return ret;
+    }
+    if (graph.valid) { DBGLOG("Support", "Connector table doesn't match the parsed graph, filtering it in place"); }
     for (size_t i = 0, j = 0; i < n; i++) {
         UInt8 conObjType = (conInfoTbl->objects[i].objectID & OBJECT_TYPE_MASK) >> OBJECT_TYPE_SHIFT;
         //! Block out all invalid entries (ones that don't have `GRAPH_OBJECT_TYPE_CONNECTOR`)
@@ -5,7 +5,9 @@
 #include "AMDCommon.hpp"
 #include "ATOMBIOS.hpp"
 #include "PatcherPlus.hpp"
+#include "Framebuffer.hpp"
 #include <Headers/kern_util.hpp>
+#include <IOKit/IOLib.h>
 #include <IOKit/IOService.h>
 
 // Taken from WhateverGreen's kern_agdc.h, used for a wrap in kern_support.cpp
@@ -76,6 +78,22 @@ struct AGDCValidateDetailedTiming_t {
     UInt16 padding3[2];
 };
 
+constexpr size_t AGDC_TIMING_CACHE_ENTRIES = 8;
+
+//! A validated timing and the result `kAGDCValidateDetailedTiming` settled on for it
+struct AGDCTimingCacheEntry {
+    UInt64 hash;
+    AGDCDetailedTimingInformation_t timing;
+    UInt32 modeStatus;
+    bool result;
+};
+
+//! Entries are replaced round-robin; a zero hash marks an unused entry
+struct AGDCTimingCache {
+    AGDCTimingCacheEntry entries[AGDC_TIMING_CACHE_ENTRIES];
+    UInt32 next;
+};
+
 using t_AcknowledgeAllOutStandingInterrupts = void (*)(void *that);
 using t_InitPulseBasedInterrupts = void (*)(void *that, bool enabled);
 
@@ -95,13 +113,23 @@ class Support {
     mach_vm_address_t orgADCStart {0};
     t_AcknowledgeAllOutStandingInterrupts IHAcknowledgeAllOutStandingInterrupts {nullptr};
     t_InitPulseBasedInterrupts IHInitPulseBasedInterrupts {nullptr};
+    //! macOS validates the same timings over and over while enumerating modes, results are kept per framebuffer
+    //! until the next link event
+    IOLock *timingCacheLock {nullptr};
+    AGDCTimingCache timingCache[MAX_FRAMEBUFFER_COUNT] {};
+    UInt32 timingCacheHits {0};
+    UInt32 timingCacheMisses {0};
+
+    bool lookupTiming(AGDCValidateDetailedTiming_t *cmd, UInt64 hash, bool &result);
+    void storeTiming(const AGDCValidateDetailedTiming_t *cmd, UInt64 hash, bool result);
+    void invalidateTimings();
 
     static bool wrapNotifyLinkChange(void *atiDeviceControl, kAGDCRegisterLinkControlEvent_t event, void *eventData,
         UInt32 eventFlags);
     static bool doNotTestVram(IOService *ctrl, UInt32 reg, bool retryOnFail);
     static IOReturn wrapPopulateDeviceMemory(void *that, UInt32 reg);
     static void *wrapCreateAtomBiosParser(void *that, void *param1, unsigned char *param2, UInt32 dceVersion);
-    static void wrapDoGPUPanic();
+    static void wrapDoGPUPanic(void *that, const char *fmt);
     static bool wrapObjectInfoTableInit(void *that, void *initdata);
     static void *wrapADCStart(void *that, IOService *provider);
 };
@@ -0,0 +1,115 @@
+//! Copyright © 2024 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.5.
+//! See LICENSE for details.
+
+#include "Telemetry.hpp"
+#include "LRed.hpp"
+#include <kern/clock.h>
+#include <libkern/OSAtomic.h>
+
+void Telemetry::init(IOService *provider) {
+    if (this->sampleCall) { return; }
+    PE_parse_boot_argn("LRedTelemetryInterval", &this->intervalMs, sizeof(this->intervalMs));
+    if (!this->intervalMs) { return; }
+
+    this->provider = provider;
+    this->samplesPerPublish = TELEMETRY_PUBLISH_INTERVAL_MS / this->intervalMs;
+    if (!this->samplesPerPublish) { this->samplesPerPublish = 1; }
+    this->sampleCall = thread_call_allocate(sampleTimer, this);
+    if (!this->sampleCall) {
+        SYSLOG("Telemetry", "Failed to allocate sample thread call");
+        return;
+    }
+    clock_interval_to_absolutetime_interval(this->intervalMs, kMillisecondScale, &this->sampleInterval);
+}
+
+void Telemetry::start() {
+    if (!this->sampleCall || !OSCompareAndSwap(0, 1, &this->started)) { return; }
+    thread_call_enter_delayed(this->sampleCall, mach_absolute_time() + this->sampleInterval);
+    DBGLOG("Telemetry", "Sampling every %ums", this->intervalMs);
+}
+
+void Telemetry::sampleTimer(thread_call_param_t param0, thread_call_param_t) {
+    auto *that = static_cast<Telemetry *>(param0);
+    that->sample();
+    if (that->head % that->samplesPerPublish == 0) { that->publish(); }
+    thread_call_enter_delayed(that->sampleCall, mach_absolute_time() + that->sampleInterval);
+}
+
+void Telemetry::sample() {
+    auto start = mach_absolute_time();
+
+    auto &entry = this->ring[this->head & (TELEMETRY_RING_SIZE - 1)];
+    entry.timestamp = start;
+    entry.busy = GRBM_STATUS__GUI_ACTIVE::get(LRed::callback->readReg32(mmGRBM_STATUS));
+    OSMemoryBarrier();
+    this->head++;
+
+    this->sampleTicks += mach_absolute_time() - start;
+}
+
+size_t Telemetry::copyTail(TelemetrySample *out, size_t count) const {
+    UInt64 head = this->head;
+    OSMemoryBarrier();
+    if (count > head) { count = static_cast<size_t>(head); }
+    if (count > TELEMETRY_RING_SIZE) { count = TELEMETRY_RING_SIZE; }
+    for (size_t i = 0; i < count; i++) { out[i] = this->ring[(head - count + i) & (TELEMETRY_RING_SIZE - 1)]; }
+    return count;
+}
+
+void Telemetry::publish() {
+    //! Aggregated over the whole ring, not just the samples since the last publish.
+    //! Only ever called from the sample thread call, so one buffer suffices.
+    static TelemetrySample samples[TELEMETRY_RING_SIZE];
+    auto count = this->copyTail(samples, TELEMETRY_RING_SIZE);
+    if (!count) { return; }
+
+    //! Busy share over the whole window and over the samples since the last publish
+    size_t busy = 0, recentBusy = 0;
+    size_t recent = count < this->samplesPerPublish ? count : this->samplesPerPublish;
+    for (size_t i = 0; i < count; i++) {
+        if (!samples[i].busy) { continue; }
+        busy++;
+        if (i >= count - recent) { recentBusy++; }
+    }
+
+    //! Busy samples in each run of `TELEMETRY_BUSY_WINDOW`, so P99 reflects bursts and not just the overall mean
+    UInt32 histogram[TELEMETRY_BUSY_WINDOW + 1] {};
+    size_t windows = 0, windowBusy = 0;
+    for (size_t i = 0; i < count; i++) {
+        windowBusy += samples[i].busy;
+        if (i >= TELEMETRY_BUSY_WINDOW) { windowBusy -= samples[i - TELEMETRY_BUSY_WINDOW].busy; }
+        if (i + 1 < TELEMETRY_BUSY_WINDOW) { continue; }
+        histogram[windowBusy]++;
+        windows++;
+    }
+    size_t p99 = 0, seen = 0;
+    for (; windows && p99 < TELEMETRY_BUSY_WINDOW; p99++) {
+        seen += histogram[p99];
+        if (seen * 100 >= windows * 99) { break; }
+    }
+
+    auto *dict = OSDictionary::withCapacity(8);
+    if (!dict) { return; }
+    uint64_t sampleNs = 0;
+    absolutetime_to_nanoseconds(this->sampleTicks / this->head, &sampleNs);
+    const struct {
+        const char *name;
+        UInt64 value;
+    } numbers[] = {
+        {"IntervalMs", this->intervalMs},
+        {"Samples", this->head},
+        {"WindowSamples", count},
+        {"MeanBusyPercent", busy * 100 / count},
+        {"RecentBusyPercent", recentBusy * 100 / recent},
+        {"P99BusyPercent", windows ? p99 * 100 / TELEMETRY_BUSY_WINDOW : busy * 100 / count},
+        {"SampleCostNs", sampleNs},
+    };
+    for (auto &entry : numbers) {
+        auto *num = OSNumber::withNumber(entry.value, 64);
+        if (!num) { continue; }
+        dict->setObject(entry.name, num);
+        num->release();
+    }
+    this->provider->setProperty("LRed Telemetry", dict);
+    dict->release();
+}
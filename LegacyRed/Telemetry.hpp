@@ -0,0 +1,45 @@
+//! Copyright © 2024 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.5.
+//! See LICENSE for details.
+
+#pragma once
+#include <Headers/kern_util.hpp>
+#include <IOKit/IOService.h>
+#include <kern/thread_call.h>
+
+constexpr size_t TELEMETRY_RING_SIZE = 256;    //! Must be a power of 2
+constexpr UInt32 TELEMETRY_PUBLISH_INTERVAL_MS = 1000;
+//! Utilisation percentiles are taken over every run of this many consecutive samples in the ring
+constexpr size_t TELEMETRY_BUSY_WINDOW = 16;
+
+struct TelemetrySample {
+    UInt64 timestamp;
+    bool busy;
+};
+
+//! Samples GPU activity every `LRedTelemetryInterval` milliseconds (off by default), once the accelerator has started.
+//! Each sample is a single GRBM_STATUS read; the busy percentage is the share of samples in the ring with GUI_ACTIVE
+//! set, so it's only meaningful over many samples.
+//! GPU activity only: the current SCLK level and the temperature are SMC registers, behind the index/data pair AMD's
+//! PowerPlay uses without any lock we could take, and the SMU8 mailbox has no message reporting either.
+//! The sampler is the only writer of the ring, readers copy out samples behind `head` and can race no one.
+class Telemetry {
+    IOService *provider {nullptr};
+    thread_call_t sampleCall {nullptr};
+    uint64_t sampleInterval {0};
+    UInt32 intervalMs {0};
+    UInt32 samplesPerPublish {1};
+    volatile UInt32 started {0};
+
+    TelemetrySample ring[TELEMETRY_RING_SIZE] {};
+    volatile UInt64 head {0};
+    UInt64 sampleTicks {0};
+
+    void sample();
+    void publish();
+    static void sampleTimer(thread_call_param_t param0, thread_call_param_t param1);
+
+    public:
+    void init(IOService *provider);
+    void start();
+    size_t copyTail(TelemetrySample *out, size_t count) const;
+};
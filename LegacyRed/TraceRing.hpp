@@ -0,0 +1,172 @@
+//! Copyright © 2024 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.5.
+//! See LICENSE for details.
+
+#pragma once
+#include <Headers/kern_util.hpp>
+#include <IOKit/IOService.h>
+#include <kern/clock.h>
+#include <libkern/OSAtomic.h>
+
+//! 'LRTR'
+constexpr UInt32 TRACE_BLOB_MAGIC = 0x5254524C;
+constexpr UInt16 TRACE_BLOB_VERSION = 1;
+
+//! What the payload of the records in a blob is, so `Scripts/DecodeTrace.py` knows how to print it
+enum struct TraceKind : UInt16 {
+    CommandBufferInfo = 1,
+    RingWrite,    //! Payload is dwords, see `RingWriteTag`
+};
+
+struct TraceBlobHeader {
+    UInt32 magic;
+    UInt16 version;
+    UInt16 kind;
+    UInt32 recordSize;
+    UInt32 recordCount;
+    UInt32 ringCount;
+    UInt32 reserved;
+} PACKED;
+
+struct TraceRecordHeader {
+    UInt64 timestamp;    //! `mach_absolute_time`
+    UInt32 sequence;     //! 1-based, 0 while the record is being written
+    UInt32 source;
+    UInt16 tag;
+    UInt16 size;         //! Valid payload bytes
+    UInt32 reserved;
+} PACKED;
+
+//! Source of records whose object couldn't be given a number
+constexpr UInt32 TRACE_SOURCE_NONE = 0xFFFFFFFF;
+//! An object that hasn't been traced for this long gives up its number to the next new one
+constexpr UInt32 TRACE_SOURCE_IDLE_MS = 1000;
+
+//! Numbers traced objects (channels, rings) in the order they're first seen, as `generation << 8 | slot`.
+//! Objects are never told to us when they go away, so instead a slot idle for `TRACE_SOURCE_IDLE_MS` is handed to
+//! the next new object; its generation changes, so records of the old and new owner stay apart.
+template<size_t SlotCount>
+class TraceSourceTable {
+    static_assert(SlotCount <= 0x100, "Slot must fit in the low byte of the source");
+
+    struct Slot {
+        void *volatile object;
+        volatile UInt64 lastUsed;
+        UInt32 generation;
+    };
+
+    Slot slots[SlotCount] {};
+    uint64_t idleTicks {0};
+    volatile SInt32 exhausted {0};
+
+    public:
+    void init() { clock_interval_to_absolutetime_interval(TRACE_SOURCE_IDLE_MS, kMillisecondScale, &this->idleTicks); }
+
+    //! `TRACE_SOURCE_NONE` when every slot belongs to an object that's still in use
+    UInt32 lookup(void *object) {
+        auto now = mach_absolute_time();
+        for (UInt32 i = 0; i < SlotCount; i++) {
+            auto &slot = this->slots[i];
+            if (slot.object != object) { continue; }
+            slot.lastUsed = now;
+            return (slot.generation << 8) | i;
+        }
+        for (UInt32 i = 0; i < SlotCount; i++) {
+            auto &slot = this->slots[i];
+            auto *owner = slot.object;
+            if (owner && now - slot.lastUsed < this->idleTicks) { continue; }
+            if (!OSCompareAndSwapPtr(owner, object, &slot.object)) { continue; }
+            if (owner) { slot.generation++; }
+            slot.lastUsed = now;
+            return (slot.generation << 8) | i;
+        }
+        OSIncrementAtomic(&this->exhausted);
+        return TRACE_SOURCE_NONE;
+    }
+
+    static size_t slotOf(UInt32 source) { return source & 0xFF; }
+
+    //! How many records couldn't be given a source
+    UInt32 exhaustedCount() const { return static_cast<UInt32>(this->exhausted); }
+};
+
+//! `RingCount` rings of `RecordCount` fixed-size records, old records are overwritten.
+//! Recording is a few stores and one uncontended atomic, so it's fit for hot paths; formatting is left to userspace.
+//! Readers may observe a record mid-write, those have a sequence that doesn't match their slot and are skipped.
+template<size_t PayloadSize, size_t RecordCount, size_t RingCount>
+class TraceRing {
+    static_assert(RecordCount && !(RecordCount & (RecordCount - 1)), "Record count must be a power of two");
+
+    struct Record {
+        TraceRecordHeader header;
+        UInt8 payload[PayloadSize];
+    } PACKED;
+
+    struct Ring {
+        volatile SInt32 head;
+        UInt32 reserved;
+        Record records[RecordCount];
+    };
+
+    Ring *rings {nullptr};
+    TraceKind kind;
+
+    public:
+    explicit constexpr TraceRing(TraceKind kind) : kind {kind} {}
+
+    bool init() {
+        if (!this->rings) { this->rings = new Ring[RingCount](); }
+        return this->rings != nullptr;
+    }
+
+    bool ready() const { return this->rings != nullptr; }
+
+    void record(size_t ring, UInt32 source, UInt16 tag, const void *data, size_t size) {
+        auto &r = this->rings[ring % RingCount];
+        auto seq = static_cast<UInt32>(OSIncrementAtomic(&r.head));
+        auto &rec = r.records[seq & (RecordCount - 1)];
+        rec.header.sequence = 0;
+        rec.header.timestamp = mach_absolute_time();
+        rec.header.source = source;
+        rec.header.tag = tag;
+        rec.header.size = static_cast<UInt16>(size < PayloadSize ? size : PayloadSize);
+        memcpy(rec.payload, data, rec.header.size);
+        OSMemoryBarrier();
+        rec.header.sequence = seq + 1;
+    }
+
+    //! Copies the newest `count` valid records of `ring` into `out`, oldest first; returns how many were copied
+    size_t copyTail(size_t ring, void *out, size_t count) const {
+        if (!this->rings) { return 0; }
+        auto &r = this->rings[ring % RingCount];
+        auto head = static_cast<UInt32>(r.head);
+        if (count > RecordCount) { count = RecordCount; }
+        if (count > head) { count = head; }
+        size_t copied = 0;
+        for (UInt32 seq = head - static_cast<UInt32>(count); seq != head; seq++) {
+            auto &rec = r.records[seq & (RecordCount - 1)];
+            if (rec.header.sequence != seq + 1) { continue; }
+            memcpy(static_cast<Record *>(out) + copied++, &rec, sizeof(Record));
+        }
+        return copied;
+    }
+
+    static constexpr size_t recordSize() { return sizeof(Record); }
+
+    OSData *serialize() const {
+        if (!this->rings) { return nullptr; }
+        TraceBlobHeader header {TRACE_BLOB_MAGIC, TRACE_BLOB_VERSION, static_cast<UInt16>(this->kind),
+            static_cast<UInt32>(sizeof(Record)), static_cast<UInt32>(RecordCount), static_cast<UInt32>(RingCount), 0};
+        auto *data = OSData::withCapacity(static_cast<UInt32>(sizeof(header) + sizeof(Ring) * RingCount));
+        if (!data) { return nullptr; }
+        data->appendBytes(&header, sizeof(header));
+        data->appendBytes(this->rings, static_cast<UInt32>(sizeof(Ring) * RingCount));
+        return data;
+    }
+
+    void publish(IOService *service, const char *name) const {
+        auto *data = this->serialize();
+        if (!data) { return; }
+        service->setProperty(name, data);
+        data->release();
+    }
+};
@@ -5,6 +5,7 @@
 #include "LRed.hpp"
 #include "Model.hpp"
 #include <Headers/kern_api.hpp>
+#include <kern/cpu_number.h>
 
 static const char *pathRadeonX4000 = "/System/Library/Extensions/AMDRadeonX4000.kext/Contents/MacOS/AMDRadeonX4000";
 static KernelPatcher::KextInfo kextRadeonX4000 {"com.apple.kext.AMDRadeonX4000", &pathRadeonX4000, 1, {}, {},
@@ -27,6 +28,28 @@ bool X4000::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t
         const bool carrizo = LRed::callback->chipType == ChipType::Carrizo;
 
         this->dumpIBs = checkKernelArgument("-X4KDumpAllIBs");
+        this->traceRings = checkKernelArgument("-X4KTraceRings");
+        this->diagnostics = checkKernelArgument("-X4KDiagnostics");
+        //! The submissions made during `performClearState` are captured in diagnostics mode
+        this->channelSources.init();
+        this->ringSources.init();
+        if ((this->dumpIBs || this->diagnostics) && !this->ibCapture.init()) {
+            SYSLOG("X4000", "Failed to allocate IB capture ring");
+        }
+        if (this->traceRings && !this->ringCapture.init()) {
+            SYSLOG("X4000", "Failed to allocate ring write capture");
+            this->traceRings = false;
+        }
+        if (this->dumpIBs || this->traceRings) {
+            this->tracePublishCall = thread_call_allocate(publishTracesTimer, this);
+            if (this->tracePublishCall) {
+                clock_interval_to_absolutetime_interval(TRACE_PUBLISH_INTERVAL_MS, kMillisecondScale,
+                    &this->tracePublishInterval);
+                thread_call_enter_delayed(this->tracePublishCall, mach_absolute_time() + this->tracePublishInterval);
+            } else {
+                SYSLOG("X4000", "Failed to allocate trace publish thread call");
+            }
+        }
 
         UInt32 *orgChannelTypes = nullptr;
         mach_vm_address_t startHWEngines = 0;
@@ -59,9 +82,6 @@ bool X4000::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t
                 {"__ZN28AMDRadeonX4000_AMDVIHardware20initializeFamilyTypeEv", wrapInitializeFamilyType},
                 {"__ZN26AMDRadeonX4000_AMDHardware12getHWChannelE20_eAMD_HW_ENGINE_TYPE18_eAMD_HW_RING_TYPE",
                     wrapGetHWChannel, this->orgGetHWChannel},
-                {"__ZN38AMDRadeonX4000_AMDVIPM4CommandsUtility26buildIndirectBufferCommandEPjyj26_eAMD_INDIRECT_BUFFER_"
-                 "TYPEjbj",
-                    wrapBuildIBCommand, this->orgBuildIBCommand},
                 {"__ZN28AMDRadeonX4000_AMDVIHardware28initializeSystemApertureRegsEv", initializeSystemApertureRegs},
             };
             PANIC_COND(!RouteRequestPlus::routeAll(patcher, index, requests, address, size), "X4000",
@@ -80,9 +100,6 @@ bool X4000::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t
                 {"__ZN31AMDRadeonX4000_AMDTongaHardware32setupAndInitializeHWCapabilitiesEv",
                     wrapSetupAndInitializeHWCapabilities},
                 {"__ZN28AMDRadeonX4000_AMDVIHardware20initializeFamilyTypeEv", wrapInitializeFamilyType},
-                {"__ZN38AMDRadeonX4000_AMDVIPM4CommandsUtility26buildIndirectBufferCommandEPjyj26_eAMD_INDIRECT_BUFFER_"
-                 "TYPEjbj",
-                    wrapBuildIBCommand, this->orgBuildIBCommand},
                 {"__ZN28AMDRadeonX4000_AMDVIHardware28initializeSystemApertureRegsEv", initializeSystemApertureRegs},
             };
             PANIC_COND(!RouteRequestPlus::routeAll(patcher, index, requests, address, size), "X4000",
@@ -104,9 +121,6 @@ bool X4000::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t
                     this->orgInitializeMicroEngine},
                 {"__ZN28AMDRadeonX4000_AMDCIHardware16initializeVMRegsEv", wrapInitializeVMRegs,
                     this->orgInitializeVMRegs},
-                {"__ZN38AMDRadeonX4000_AMDCIPM4CommandsUtility26buildIndirectBufferCommandEPjyj26_eAMD_INDIRECT_BUFFER_"
-                 "TYPEjbj",
-                    wrapBuildIBCommand, this->orgBuildIBCommand},
                 {"__ZN28AMDRadeonX4000_AMDCIHardware28initializeSystemApertureRegsEv", initializeSystemApertureRegs},
             };
             PANIC_COND(!RouteRequestPlus::routeAll(patcher, index, requests, address, size), "X4000",
@@ -122,18 +136,46 @@ bool X4000::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t
                 orgHwlInitGlobalParams},
             {"__ZN35AMDRadeonX4000_AMDAccelVideoContext9getHWInfoEP13sHardwareInfo", wrapGetHWInfo, this->orgGetHWInfo},
             {"__ZN29AMDRadeonX4000_AMDHWRegisters5writeEjj", wrapAMDHWRegsWrite, this->orgAMDHWRegsWrite},
-            {"__ZN29AMDRadeonX4000_AMDCommandRing9writeDataEPKjj", wrapWriteData, this->orgWriteData},
-            {"__ZN25AMDRadeonX4000_IAMDHWRing5writeEj", wrapHWRingWrite, this->orgHWRingWrite},
-            {"__ZN27AMDRadeonX4000_AMDHWChannel19submitCommandBufferEP30AMD_SUBMIT_COMMAND_BUFFER_INFO",
-                wrapSubmitCommandBufferInfo, this->orgSubmitCommandBufferInfo},
-            {"__ZN30AMDRadeonX4000_AMDPM4HWChannel17performClearStateEv", performClearState,
-                this->orgPerformClearState},
             {"__ZN26AMDRadeonX4000_AMDHWMemory12getRangeInfoE22eAMD_MEMORY_RANGE_TYPEP21AMD_MEMORY_RANGE_INFO",
                 wrapGetRangeInfo, this->orgGetRangeInfo},
         };
         PANIC_COND(!RouteRequestPlus::routeAll(patcher, index, requests, address, size), "X4000",
             "Failed to route symbols");
 
+        //! Observational hooks, these only log or capture so they aren't routed unless asked for
+        if (this->diagnostics) {
+            RouteRequestPlus requests[] = {
+                {LRed::callback->gcn3 ?
+                        "__ZN38AMDRadeonX4000_AMDVIPM4CommandsUtility26buildIndirectBufferCommandEPjyj26_eAMD_"
+                        "INDIRECT_BUFFER_TYPEjbj" :
+                        "__ZN38AMDRadeonX4000_AMDCIPM4CommandsUtility26buildIndirectBufferCommandEPjyj26_eAMD_"
+                        "INDIRECT_BUFFER_TYPEjbj",
+                    wrapBuildIBCommand, this->orgBuildIBCommand},
+                {"__ZN30AMDRadeonX4000_AMDPM4HWChannel17performClearStateEv", performClearState,
+                    this->orgPerformClearState},
+            };
+            PANIC_COND(!RouteRequestPlus::routeAll(patcher, index, requests, address, size), "X4000",
+                "Failed to route diagnostics symbols");
+        }
+
+        if (this->dumpIBs || this->diagnostics) {
+            RouteRequestPlus request {
+                "__ZN27AMDRadeonX4000_AMDHWChannel19submitCommandBufferEP30AMD_SUBMIT_COMMAND_BUFFER_INFO",
+                wrapSubmitCommandBufferInfo, this->orgSubmitCommandBufferInfo};
+            PANIC_COND(!request.route(patcher, index, address, size), "X4000",
+                "Failed to route submitCommandBuffer");
+        }
+
+        //! These sit on the command submission hot path, so they're only routed when tracing
+        if (this->traceRings) {
+            RouteRequestPlus requests[] = {
+                {"__ZN29AMDRadeonX4000_AMDCommandRing9writeDataEPKjj", wrapWriteData, this->orgWriteData},
+                {"__ZN25AMDRadeonX4000_IAMDHWRing5writeEj", wrapHWRingWrite, this->orgHWRingWrite},
+            };
+            PANIC_COND(!RouteRequestPlus::routeAll(patcher, index, requests, address, size), "X4000",
+                "Failed to route ring write symbols");
+        }
+
         if (stoney) {
             PANIC_COND(MachInfo::setKernelWriting(true, KernelPatcher::kernelWriteLock) != KERN_SUCCESS, "X4000",
                 "Failed to enable kernel writing");
@@ -152,9 +194,6 @@ bool X4000::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t
             DBGLOG("X4000", "Applied Singular SDMA lookup patch");
         }
 
-        this->mcLocation = ((LRed::callback->readReg32(mmMC_VM_FB_LOCATION) & 0xFFFF) << 24);
-        DBGLOG("X4000", "mcLocation: 0x%llx", this->mcLocation);
-
         return true;
     }
 
@@ -165,6 +204,14 @@ bool X4000::wrapAccelStart(void *that, IOService *provider) {
     DBGLOG("X4000", "accelStart << (this: %p provider: %p)", that, provider);
     callback->callbackAccelerator = that;
     auto ret = FunctionCast(wrapAccelStart, callback->orgAccelStart)(that, provider);
+    if (ret) {
+        //! PowerPlay has started DPM by now, so its own SCLK limits can't override the profile anymore
+        if (LRed::callback->gcn3) {
+            LRed::callback->smu8.applyProfile();
+            LRed::callback->smu8.publish(LRed::callback->iGPU);
+        }
+        LRed::callback->telemetry.start();
+    }
     DBGLOG("X4000", "accelStart >> %d", ret);
     return ret;
 }
@@ -197,7 +244,8 @@ void X4000::wrapSetupAndInitializeHWCapabilities(void *that) {
 void X4000::wrapInitializeFamilyType(void *that) {
     DBGLOG("X4000", "initializeFamilyType << %x", LRed::callback->familyId);
     getMember<UInt32>(that, 0x308) = LRed::callback->familyId;
-    auto *model = getBranding(LRed::callback->deviceId, LRed::callback->pciRevision);
+    auto *model =
+        getBranding(LRed::callback->deviceId, LRed::callback->pciRevision, LRed::callback->asic->fallbackBranding);
     //! Why do we set it here?
     //! Our controller kexts override it if done @ processPatcher
     if (model) {
@@ -215,14 +263,13 @@ void *X4000::wrapGetHWChannel(void *that, UInt32 engineType, UInt32 ringId) {
 
 void X4000::wrapDumpASICHangState() {
     DBGLOG("X4000", "dumpASICHangState <<");
+    LRed::callback->hangCapture.capture(HangReason::ASICHangState, "dumpASICHangState");
     while (true) { IOSleep(36000000); }
 }
 
 UInt64 X4000::wrapAdjustVRAMAddress(void *that, UInt64 addr) {
     auto ret = FunctionCast(wrapAdjustVRAMAddress, callback->orgAdjustVRAMAddress)(that, addr);
-    SYSLOG("X4000", "AdjustVRAMAddress: returned: 0x%llx, our value: 0x%llx", ret,
-        ret != addr ? (ret + LRed::callback->fbOffset) : ret);
-    return ret != addr ? (ret + LRed::callback->fbOffset) : ret;
+    return ret != addr ? (ret + LRed::callback->addressSpace.fbOffset) : ret;
 }
 
 bool X4000::wrapInitializeMicroEngine(void *that) {
@@ -281,8 +328,7 @@ bool X4000::wrapAMDSMLVCEInit(void *that) {
 
 //! free dmesg spam for 150$!!!!!!
 void X4000::wrapAMDHWRegsWrite(void *that, UInt32 addr, UInt32 val) {
-    DBGLOG("X4000", "ACCEL REG WRITE >> addr: 0x%x, val: 0x%x", addr, val);
-    if (addr == mmSRBM_SOFT_RESET) {
+    if (UNLIKELY(addr == mmSRBM_SOFT_RESET)) {
         val &= ~SRBM_SOFT_RESET__SOFT_RESET_MC_MASK;
         DBGLOG("X4000", "Stripping SRBM_SOFT_RESET__SOFT_RESET_MC_MASK bit");
     }
@@ -290,12 +336,13 @@ void X4000::wrapAMDHWRegsWrite(void *that, UInt32 addr, UInt32 val) {
 }
 
 uint64_t X4000::wrapWriteData(void *that, const UInt32 *data, UInt32 size) {
-    SYSLOG("X4000", "COMMAND RING WRITE --- DATA: 0x%x --- SIZE: 0x%x", *data, size);
+    //! `size` is in dwords
+    callback->captureRingWrite(that, kRingWriteTagWriteData, data, size);
     return FunctionCast(wrapWriteData, callback->orgWriteData)(that, data, size);
 }
 
 bool X4000::wrapHWRingWrite(void *that, UInt32 data) {
-    SYSLOG("X4000", "IAMDHWRing WRITE --- DATA: 0x%x", data);
+    callback->captureRingWrite(that, kRingWriteTagHWRingWrite, &data, 1);
     return FunctionCast(wrapHWRingWrite, callback->orgHWRingWrite)(that, data);
 }
 
@@ -322,23 +369,73 @@ bool X4000::performClearState(void *that) {
         LRed::callback->readReg32(mmMC_VM_SYSTEM_APERTURE_DEFAULT_ADDR));
     auto ret = FunctionCast(performClearState, callback->orgPerformClearState)(that);
     isInPerformClearState = false;
+    callback->publishTraces();
     return ret;
 }
 
+//! Each ring owns the trace ring of its source slot, so ring writes of different rings never share one.
+//! When all slots are in use, the write is dropped rather than mixed into another ring's stream.
+void X4000::captureRingWrite(void *ring, RingWriteTag tag, const UInt32 *data, UInt32 count) {
+    if (!this->ringCapture.ready()) { return; }
+    auto source = this->ringSources.lookup(ring);
+    if (UNLIKELY(source == TRACE_SOURCE_NONE)) {
+        SYSLOG_COND(this->ringSources.exhaustedCount() == 1, "X4000",
+            "More than %zu rings are being traced, dropping ring writes", TRACED_RINGS);
+        return;
+    }
+    auto slot = decltype(this->ringSources)::slotOf(source);
+    for (UInt32 off = 0; off < count; off += RING_CAPTURE_DWORDS) {
+        auto chunk = (count - off) < RING_CAPTURE_DWORDS ? (count - off) : RING_CAPTURE_DWORDS;
+        this->ringCapture.record(slot, source, tag, data + off, chunk * sizeof(UInt32));
+    }
+}
+
+//! Oldest first within each ring
+size_t X4000::copyRingTraceTail(void *out, size_t maxRecords, size_t perRing) const {
+    size_t copied = 0;
+    for (size_t ring = 0; ring < TRACED_RINGS && copied < maxRecords; ring++) {
+        auto count = (maxRecords - copied) < perRing ? (maxRecords - copied) : perRing;
+        copied += this->ringCapture.copyTail(ring, static_cast<UInt8 *>(out) + copied * ringTraceRecordSize(), count);
+    }
+    return copied;
+}
+
+void X4000::publishTraces() {
+    this->ibCapture.publish(LRed::callback->iGPU, "X4000 IB Capture");
+    this->ringCapture.publish(LRed::callback->iGPU, "X4000 Ring Capture");
+
+    auto *dict = OSDictionary::withCapacity(2);
+    if (!dict) { return; }
+    const struct {
+        const char *name;
+        UInt64 value;
+    } numbers[] = {
+        {"ChannelSourcesExhausted", this->channelSources.exhaustedCount()},
+        {"RingSourcesExhausted", this->ringSources.exhaustedCount()},
+    };
+    for (auto &entry : numbers) {
+        auto *num = OSNumber::withNumber(entry.value, 64);
+        if (!num) { continue; }
+        dict->setObject(entry.name, num);
+        num->release();
+    }
+    LRed::callback->iGPU->setProperty("X4000 Trace Sources", dict);
+    dict->release();
+}
+
+void X4000::publishTracesTimer(thread_call_param_t param0, thread_call_param_t) {
+    auto *that = static_cast<X4000 *>(param0);
+    that->publishTraces();
+    thread_call_enter_delayed(that->tracePublishCall, mach_absolute_time() + that->tracePublishInterval);
+}
+
+//! Decode the captures with `Scripts/DecodeTrace.py`
 UInt32 X4000::wrapSubmitCommandBufferInfo(void *that, UInt8 *data) {
-    if (isInPerformClearState || callback->dumpIBs) {
-        const size_t size = 2048;
-        char *output = new char[size];
-        bzero(output, size);
-        for (size_t i = 0; i < 0x60; i++) {
-            if ((i + 1) % 0x10) {
-                sprintf(output, "%s %02X", output, data[i]);
-            } else {
-                sprintf(output, "%s %02X\n", output, data[i]);
-            }
-        }
-        SYSLOG("X4000", "COMMAND_BUFFER_INFO:\n%s", output);
-        delete[] output;
+    if ((isInPerformClearState || callback->dumpIBs) && callback->ibCapture.ready()) {
+        auto source = callback->channelSources.lookup(that);
+        SYSLOG_COND(source == TRACE_SOURCE_NONE && callback->channelSources.exhaustedCount() == 1, "X4000",
+            "More than %zu channels are submitting, recording submissions without a channel", MAX_TRACE_CHANNELS);
+        callback->ibCapture.record(static_cast<size_t>(cpu_number()), source, 0, data, IB_CAPTURE_SIZE);
     }
     auto ret = FunctionCast(wrapSubmitCommandBufferInfo, callback->orgSubmitCommandBufferInfo)(that, data);
     return ret;
@@ -350,7 +447,8 @@ UInt64 X4000::wrapBuildIBCommand(void *that, UInt32 *rawPkt, UInt64 param2, UInt
         param7);
     auto ret = FunctionCast(wrapBuildIBCommand, callback->orgBuildIBCommand)(that, rawPkt, param2, param3, ibType,
         param5, param6, param7);
-    DBGLOG("X4000", "IB: 0x%x, 0x%x, 0x%x, 0x%x", *rawPkt, rawPkt[1], rawPkt[2], rawPkt[3]);
+    //! INDIRECT_BUFFER is a header and three body dwords
+    callback->captureRingWrite(that, kRingWriteTagBuildIB, rawPkt, 4);
     return ret;
 }
 
@@ -360,12 +458,12 @@ enum AMDMemoryRangeType {
 
 bool X4000::wrapGetRangeInfo(void *that, int memType, void *outData) {
     auto ret = FunctionCast(wrapGetRangeInfo, callback->orgGetRangeInfo)(that, memType, outData);
-    DBGLOG("X4000", "getRangeInfo - off 0x0: 0x%llx - off 0x8: 0x%llx - off 0x10: 0x%llx",
+    DBGLOG_COND(callback->diagnostics, "X4000", "getRangeInfo - off 0x0: 0x%llx - off 0x8: 0x%llx - off 0x10: 0x%llx",
         getMember<UInt64>(outData, 0x0), getMember<UInt64>(outData, 0x8), getMember<UInt64>(outData, 0x10));
     if (memType == kAMDMemoryRangeTypeGART) {
         //! So... this stopped the page faulting. But the PM4 remains hung. What am I missing?
-        getMember<UInt64>(outData, 0x0) = APU_COMMON_GART_PADDR; //! same as before
-        getMember<UInt64>(outData, 0x8) = CIK_DEFAULT_GART_SIZE;
+        getMember<UInt64>(outData, 0x0) = LRed::callback->addressSpace.gartStart;
+        getMember<UInt64>(outData, 0x8) = LRed::callback->addressSpace.gartSize;
     }
     return ret;
 }
@@ -375,18 +473,20 @@ void X4000::initializeSystemApertureRegs(void *) {
     //!    0xFEFFFFF
 
     //! do these in X4K order
-    LRed::callback->writeReg32(mmMC_VM_SYSTEM_APERTURE_HIGH_ADDR, (LRed::callback->vramEnd >> 12)); //! VRAM START
-    LRed::callback->writeReg32(mmMC_VM_SYSTEM_APERTURE_LOW_ADDR, (LRed::callback->vramStart >> 12));
-    if (checkKernelArgument("-X4KProgramAperDefault")) { //! tmp 4 if the 0 write has the PM4 still borked
-        LRed::callback->writeReg32(mmMC_VM_SYSTEM_APERTURE_DEFAULT_ADDR, (LRed::callback->vramStart >> 12));
+    auto *lred = LRed::callback;
+    auto &addressSpace = lred->addressSpace;
+    lred->writeReg32Shadowed(mmMC_VM_SYSTEM_APERTURE_HIGH_ADDR, addressSpace.systemApertureHigh());    //! VRAM START
+    lred->writeReg32Shadowed(mmMC_VM_SYSTEM_APERTURE_LOW_ADDR, addressSpace.systemApertureLow());
+    if (checkKernelArgument("-X4KProgramAperDefault")) {    //! tmp 4 if the 0 write has the PM4 still borked
+        lred->writeReg32Shadowed(mmMC_VM_SYSTEM_APERTURE_DEFAULT_ADDR, addressSpace.systemApertureLow());
     } else {
-        //! `mem_scratch.gpu_addr` tf is that?
-        LRed::callback->writeReg32(mmMC_VM_SYSTEM_APERTURE_DEFAULT_ADDR, 0x0); //! does the PM4 need this to be non-zero here?
+        //! `mem_scratch.gpu_addr` tf is that? does the PM4 need this to be non-zero here?
+        lred->writeReg32Shadowed(mmMC_VM_SYSTEM_APERTURE_DEFAULT_ADDR, 0x0);
     }
 
-    LRed::callback->writeReg32(mmVM_CONTEXT0_PROTECTION_FAULT_DEFAULT_ADDR, 0x0); //! does this ever get reprogrammed?
+    lred->writeReg32Shadowed(mmVM_CONTEXT0_PROTECTION_FAULT_DEFAULT_ADDR, 0x0);    //! does this ever get reprogrammed?
 
-    LRed::callback->writeReg32(mmMC_VM_AGP_BASE, 0x0);
-    LRed::callback->writeReg32(mmMC_VM_AGP_TOP, 0x0);
-    LRed::callback->writeReg32(mmMC_VM_AGP_BOT, AGP_DISABLE_ADDR);
-}
\ No newline at end of file
+    lred->writeReg32Shadowed(mmMC_VM_AGP_BASE, GPUAddressSpace::agpBase());
+    lred->writeReg32Shadowed(mmMC_VM_AGP_TOP, GPUAddressSpace::agpTop());
+    lred->writeReg32Shadowed(mmMC_VM_AGP_BOT, GPUAddressSpace::agpBot());
+}
@@ -5,14 +5,38 @@
 #include "AMDCommon.hpp"
 #include "LRed.hpp"
 #include "PatcherPlus.hpp"
+#include "TraceRing.hpp"
 #include <Headers/kern_util.hpp>
 #include <IOKit/IOService.h>
+#include <kern/thread_call.h>
+
+//! `AMD_SUBMIT_COMMAND_BUFFER_INFO` bytes kept per submission
+constexpr size_t IB_CAPTURE_SIZE = 0x60;
+constexpr size_t IB_CAPTURE_RECORDS = 64;
+//! Traces are recorded into per-CPU rings, CPUs past this share rings
+constexpr size_t TRACE_CPU_RINGS = 8;
+//! Dwords kept per ring write record, longer writes span several records
+constexpr size_t RING_CAPTURE_DWORDS = 16;
+constexpr size_t RING_CAPTURE_RECORDS = 128;
+//! Ring writes are recorded into one trace ring per HW ring (or PM4 utility object); past this many active ones,
+//! writes aren't recorded
+constexpr size_t TRACED_RINGS = 8;
+constexpr size_t MAX_TRACE_CHANNELS = 16;
+constexpr UInt32 TRACE_PUBLISH_INTERVAL_MS = 1000;
+
+enum RingWriteTag : UInt16 {
+    kRingWriteTagWriteData = 0,    //! `AMDCommandRing::writeData`
+    kRingWriteTagHWRingWrite,      //! `IAMDHWRing::write`
+    kRingWriteTagBuildIB,          //! Packet built by `buildIndirectBufferCommand`
+};
 
 class X4000 {
     public:
     static X4000 *callback;
     void init();
     bool processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size);
+    size_t copyRingTraceTail(void *out, size_t maxRecords, size_t perRing) const;
+    static constexpr size_t ringTraceRecordSize() { return decltype(ringCapture)::recordSize(); }
 
     private:
     mach_vm_address_t orgAccelStart {0};
@@ -34,8 +58,19 @@ class X4000 {
     mach_vm_address_t orgGetRangeInfo {0};
 
     void *callbackAccelerator = nullptr;
-    UInt64 mcLocation;
     bool dumpIBs {false};
+    bool traceRings {false};
+    bool diagnostics {false};
+    TraceRing<IB_CAPTURE_SIZE, IB_CAPTURE_RECORDS, TRACE_CPU_RINGS> ibCapture {TraceKind::CommandBufferInfo};
+    TraceRing<RING_CAPTURE_DWORDS * 4, RING_CAPTURE_RECORDS, TRACED_RINGS> ringCapture {TraceKind::RingWrite};
+    TraceSourceTable<MAX_TRACE_CHANNELS> channelSources {};
+    TraceSourceTable<TRACED_RINGS> ringSources {};
+    thread_call_t tracePublishCall {nullptr};
+    uint64_t tracePublishInterval {0};
+
+    void captureRingWrite(void *ring, RingWriteTag tag, const UInt32 *data, UInt32 count);
+    void publishTraces();
+    static void publishTracesTimer(thread_call_param_t param0, thread_call_param_t param1);
 
     static bool wrapAccelStart(void *that, IOService *provider);
     static void *wrapGetHWChannel(void *that, UInt32 engineType, UInt32 ringId);
@@ -0,0 +1,174 @@
+#!/usr/bin/python3
+
+# Decodes the binary trace blobs and hang snapshots LegacyRed publishes in the IORegistry.
+# Accepts either a raw blob or the output of `ioreg -a -l -w0 -r -n <GPU name>`, every blob found is decoded.
+
+import plistlib
+import struct
+import sys
+
+from PM4Decode import print_pm4
+
+TRACE_BLOB_MAGIC = 0x5254524C
+HANG_SNAPSHOT_MAGIC = 0x5348524C
+TRACE_BLOB_VERSION = 1
+BLOB_HEADER = struct.Struct("<IHHIIII")
+RING_HEADER = struct.Struct("<iI")
+RECORD_HEADER = struct.Struct("<QIIHHI")
+HANG_SNAPSHOT_HEADER = struct.Struct("<IHHQIIII64s")
+
+HANG_REASONS = {1: "dumpASICHangState", 2: "doGPUPanic"}
+HANG_REGS = {
+    0x393: "SRBM_STATUS2",
+    0x394: "SRBM_STATUS",
+    0x2002: "GRBM_STATUS2",
+    0x2004: "GRBM_STATUS",
+    0x21A0: "CP_STAT",
+    0x21B6: "CP_ME_CNTL",
+    0x3040: "CP_RB0_BASE",
+    0x3041: "CP_RB0_CNTL",
+    0x21C0: "CP_RB0_RPTR",
+    0x3045: "CP_RB0_WPTR",
+    0x537: "VM_CONTEXT1_PROTECTION_FAULT_STATUS",
+    0x53F: "VM_CONTEXT1_PROTECTION_FAULT_ADDR",
+    0xE30: "IH_RB_CNTL",
+    0xE32: "IH_RB_RPTR",
+    0xE33: "IH_RB_WPTR",
+    0xE38: "IH_STATUS",
+}
+
+KIND_RING_WRITE = 2
+TAG_BUILD_IB_COMMAND = 2
+TRACE_SOURCE_NONE = 0xFFFFFFFF
+
+
+def parse_blob(blob: bytes) -> tuple[int, list[tuple[int, int, int, int, int, bytes]]]:
+    magic, version, kind, record_size, record_count, ring_count, _ = BLOB_HEADER.unpack_from(blob)
+    assert magic == TRACE_BLOB_MAGIC, "Not a trace blob"
+    assert version == TRACE_BLOB_VERSION, f"Unsupported trace blob version {version}"
+
+    records = []
+    off = BLOB_HEADER.size
+    for ring in range(ring_count):
+        head, _ = RING_HEADER.unpack_from(blob, off)
+        off += RING_HEADER.size
+        for slot in range(record_count):
+            rec_off = off + slot * record_size
+            timestamp, seq, source, tag, size, _ = RECORD_HEADER.unpack_from(blob, rec_off)
+            # Empty or torn slot
+            if seq == 0 or (seq - 1) % record_count != slot:
+                continue
+            payload_off = rec_off + RECORD_HEADER.size
+            records.append((timestamp, ring, seq, source, tag, blob[payload_off:payload_off + size]))
+        off += record_size * record_count
+    records.sort()
+    return kind, records
+
+
+# Sources are `generation << 8 | slot`, a slot is reused by a new object once its previous owner went idle
+def format_source(source: int) -> str:
+    if source == TRACE_SOURCE_NONE:
+        return "?"
+    return f"{source & 0xFF}.{source >> 8}"
+
+
+def format_hex(data: bytes) -> str:
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append("    " + " ".join(f"{b:02X}" for b in data[i:i + 16]))
+    return "\n".join(lines)
+
+
+def to_dwords(payload: bytes) -> list[int]:
+    return list(struct.unpack(f"<{len(payload) // 4}I", payload[:len(payload) // 4 * 4]))
+
+
+# Ring writes of each ring (slot and generation) are stitched back together in time order and decoded as one PM4 stream
+def print_ring_writes(records):
+    streams: dict[int, list[int]] = {}
+    for timestamp, ring, seq, source, tag, payload in records:
+        if tag == TAG_BUILD_IB_COMMAND:
+            print(f"[{timestamp}] buildIndirectBufferCommand ({format_source(source)})")
+            print_pm4(to_dwords(payload), "    ")
+        else:
+            streams.setdefault(source, []).extend(to_dwords(payload))
+    for source, dwords in sorted(streams.items()):
+        print(f"ring {format_source(source)}: {len(dwords)} dwords")
+        print_pm4(dwords, "    ")
+
+
+def print_blob(name: str, blob: bytes):
+    kind, records = parse_blob(blob)
+    print(f"{name}: {len(records)} records")
+    if kind == KIND_RING_WRITE:
+        print_ring_writes(records)
+        return
+    for timestamp, ring, seq, source, tag, payload in records:
+        print(f"[{timestamp}] cpu {ring} seq {seq} channel {format_source(source)} tag {tag}")
+        print(format_hex(payload))
+
+
+# The header and registers are also stored in NVRAM as `lred-hang-snapshot`, in which case there's no trace tail
+def print_hang_snapshot(name: str, blob: bytes):
+    magic, version, reason, timestamp, reg_count, tail_count, tail_record_size, _, message = \
+        HANG_SNAPSHOT_HEADER.unpack_from(blob)
+    assert version == 1, f"Unsupported hang snapshot version {version}"
+    message = message.split(b"\0")[0].decode(errors="replace")
+    print(f"{name}: {HANG_REASONS.get(reason, reason)} at {timestamp}: {message}")
+    off = HANG_SNAPSHOT_HEADER.size
+    for _ in range(reg_count):
+        reg, value = struct.unpack_from("<II", blob, off)
+        print(f"    {HANG_REGS.get(reg, f'0x{reg:X}'):40} 0x{value:08X}")
+        off += 8
+
+    records = []
+    for _ in range(tail_count):
+        if off + tail_record_size > len(blob):
+            break
+        timestamp, seq, source, tag, size, _ = RECORD_HEADER.unpack_from(blob, off)
+        payload_off = off + RECORD_HEADER.size
+        records.append((timestamp, source, seq, source, tag, blob[payload_off:payload_off + size]))
+        off += tail_record_size
+    if records:
+        records.sort()
+        print_ring_writes(records)
+
+
+def print_any(name: str, blob: bytes):
+    if struct.unpack_from("<I", blob)[0] == HANG_SNAPSHOT_MAGIC:
+        print_hang_snapshot(name, blob)
+    else:
+        print_blob(name, blob)
+
+
+def find_blobs(obj, name="blob"):
+    if isinstance(obj, dict):
+        for key, value in obj.items():
+            yield from find_blobs(value, key)
+    elif isinstance(obj, list):
+        for value in obj:
+            yield from find_blobs(value, name)
+    elif isinstance(obj, bytes) and len(obj) >= BLOB_HEADER.size and \
+            struct.unpack_from("<I", obj)[0] in (TRACE_BLOB_MAGIC, HANG_SNAPSHOT_MAGIC):
+        yield name, obj
+
+
+def main():
+    if len(sys.argv) != 2:
+        print(f"Usage: {sys.argv[0]} <blob or ioreg -a output>")
+        sys.exit(1)
+
+    with open(sys.argv[1], "rb") as f:
+        data = f.read()
+
+    if data.startswith(b"<?xml") or data.startswith(b"bplist"):
+        blobs = list(find_blobs(plistlib.loads(data)))
+    else:
+        blobs = [("blob", data)]
+
+    for name, blob in blobs:
+        print_any(name, blob)
+
+
+if __name__ == "__main__":
+    main()
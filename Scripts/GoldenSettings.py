@@ -0,0 +1,214 @@
+#!/usr/bin/python3
+
+# Decodes the golden register settings LegacyRed publishes as `LRed Golden Settings` and, optionally, diffs them
+# against what Linux amdgpu would program for the same chip.
+# Accepts either a raw blob or the output of `ioreg -a -l -w0 -r -n <GPU name>`.
+# Register names come from `LegacyRed/AMDCommon.hpp` and, when given, the amdgpu register headers.
+
+import argparse
+import pathlib
+import plistlib
+import re
+import struct
+import sys
+
+GOLDEN_BLOB_MAGIC = 0x5347524C
+GOLDEN_BLOB_VERSION = 1
+BLOB_HEADER = struct.Struct("<IHHIII")
+SETTING = struct.Struct("<III")
+
+CHIP_TYPES = ["Spectre", "Spooky", "Kalindi", "Godavari", "Carrizo", "Stoney"]
+
+# (file relative to the amdgpu directory, array) in the order amdgpu programs them,
+# see `cik_init_golden_registers`, `vi_init_golden_registers` and `gfx_v8_0_init_golden_registers`.
+SPECTRE_TABLES = [("cik.c", "spectre_mgcg_cgcg_init"), ("cik.c", "spectre_golden_registers"),
+                  ("cik.c", "spectre_golden_common_registers"), ("cik.c", "spectre_golden_spm_registers")]
+AMDGPU_TABLES = {
+    "Spectre": SPECTRE_TABLES,
+    "Spooky": SPECTRE_TABLES,
+    "Kalindi": [("cik.c", "kalindi_mgcg_cgcg_init"), ("cik.c", "kalindi_golden_registers"),
+                ("cik.c", "kalindi_golden_common_registers"), ("cik.c", "kalindi_golden_spm_registers")],
+    "Godavari": [("cik.c", "kalindi_mgcg_cgcg_init"), ("cik.c", "godavari_golden_registers"),
+                 ("cik.c", "kalindi_golden_common_registers"), ("cik.c", "kalindi_golden_spm_registers")],
+    "Carrizo": [("vi.c", "cz_mgcg_cgcg_init"), ("gfx_v8_0.c", "cz_mgcg_cgcg_init"),
+                ("gfx_v8_0.c", "cz_golden_settings_a11"), ("gfx_v8_0.c", "cz_golden_common_all")],
+    "Stoney": [("vi.c", "stoney_mgcg_cgcg_init"), ("gfx_v8_0.c", "stoney_mgcg_cgcg_init"),
+               ("gfx_v8_0.c", "stoney_golden_settings_a11"), ("gfx_v8_0.c", "stoney_golden_common_all")],
+}
+
+# Register headers used to resolve symbolic offsets, first definition wins.
+AMDGPU_HEADERS = {
+    "CIK": ["gca/gfx_7_2_d.h", "gmc/gmc_7_1_d.h", "oss/oss_2_0_d.h", "bif/bif_4_1_d.h", "smu/smu_7_0_1_d.h",
+            "dce/dce_8_0_d.h", "uvd/uvd_4_2_d.h", "vce/vce_2_0_d.h", "sdma0/sdma0_4_0_d.h"],
+    "VI": ["gca/gfx_8_0_d.h", "gmc/gmc_8_1_d.h", "oss/oss_3_0_d.h", "bif/bif_5_0_d.h", "smu/smu_8_0_d.h",
+           "dce/dce_11_0_d.h", "uvd/uvd_6_0_d.h", "vce/vce_3_0_d.h", "sdma0/sdma0_3_0_d.h"],
+}
+
+
+def generation(chip: str) -> str:
+    return "VI" if chip in ("Carrizo", "Stoney") else "CIK"
+
+
+def parse_blob(blob: bytes):
+    magic, version, chip_type, family_id, device_id, count = BLOB_HEADER.unpack_from(blob)
+    if magic != GOLDEN_BLOB_MAGIC:
+        raise ValueError(f"bad magic 0x{magic:08X}")
+    if version != GOLDEN_BLOB_VERSION:
+        raise ValueError(f"unsupported version {version}")
+    chip = CHIP_TYPES[chip_type] if chip_type < len(CHIP_TYPES) else f"Unknown ({chip_type})"
+    settings = [SETTING.unpack_from(blob, BLOB_HEADER.size + i * SETTING.size) for i in range(count)]
+    return chip, family_id, device_id, settings
+
+
+def find_blob(data: bytes) -> bytes:
+    if not (data.startswith(b"<?xml") or data.startswith(b"bplist")):
+        return data
+
+    def walk(obj):
+        if isinstance(obj, dict):
+            if isinstance(obj.get("LRed Golden Settings"), bytes):
+                return obj["LRed Golden Settings"]
+            obj = list(obj.values())
+        if isinstance(obj, list):
+            for value in obj:
+                if (found := walk(value)) is not None:
+                    return found
+        return None
+
+    blob = walk(plistlib.loads(data))
+    if blob is None:
+        raise ValueError("no `LRed Golden Settings` property found")
+    return blob
+
+
+def parse_register_names(path: pathlib.Path) -> dict[int, str]:
+    names = {}
+    for name, value in re.findall(r"constexpr\s+UInt32\s+mm(\w+)\s*=\s*(0x[0-9A-Fa-f]+)", path.read_text()):
+        names.setdefault(int(value, 16), name)
+    return names
+
+
+def parse_amdgpu_headers(amdgpu: pathlib.Path, chip: str) -> dict[str, int]:
+    regs = {}
+    include = amdgpu.resolve().parent / "include" / "asic_reg"
+    for header in AMDGPU_HEADERS[generation(chip)]:
+        path = include / header
+        if not path.exists():
+            print(f"warning: {path} not found, its registers can't be resolved", file=sys.stderr)
+            continue
+        for name, value in re.findall(r"#define\s+mm(\w+)\s+(0x[0-9A-Fa-f]+)", path.read_text()):
+            regs.setdefault(name, int(value, 16))
+    return regs
+
+
+def parse_amdgpu_array(source: str, name: str, regs: dict[str, int]) -> list[tuple[int, int, int]]:
+    match = re.search(r"static\s+const\s+u32\s+" + name + r"\s*\[\]\s*=\s*\{(.*?)\};", source, re.S)
+    if match is None:
+        return []
+    body = re.sub(r"/\*.*?\*/|//[^\n]*", "", match.group(1), flags=re.S)
+    values = []
+    for token in (token.strip() for token in body.split(",")):
+        if not token:
+            continue
+        if token.startswith("mm"):
+            if token[2:] not in regs:
+                raise ValueError(f"{name}: unknown register {token}")
+            values.append(regs[token[2:]])
+        else:
+            values.append(int(token, 0))
+    if len(values) % 3:
+        raise ValueError(f"{name}: not a list of (offset, and mask, or mask) triples")
+    return [tuple(values[i:i + 3]) for i in range(0, len(values), 3)]
+
+
+def apply(state: dict[int, tuple[int, int]], offset: int, mask: int, value: int):
+    # Same semantics as `amdgpu_device_program_register_sequence`, tracking which bits end up defined.
+    if mask == 0xFFFFFFFF:
+        state[offset] = (0xFFFFFFFF, value)
+        return
+    old_mask, old_value = state.get(offset, (0, 0))
+    state[offset] = (old_mask | mask, (old_value & ~mask) | (value & mask))
+
+
+def amdgpu_settings(amdgpu: pathlib.Path, chip: str, regs: dict[str, int]) -> dict[int, tuple[int, int]]:
+    state = {}
+    for file, name in AMDGPU_TABLES[chip]:
+        path = amdgpu / file
+        if not path.exists():
+            print(f"warning: {path} not found, skipping {name}", file=sys.stderr)
+            continue
+        triples = parse_amdgpu_array(path.read_text(), name, regs)
+        if not triples:
+            print(f"warning: {name} not found in {path}", file=sys.stderr)
+        for offset, mask, value in triples:
+            apply(state, offset, mask, value)
+    return state
+
+
+def reg_name(names: dict[int, str], offset: int) -> str:
+    return names.get(offset, f"0x{offset:04X}")
+
+
+def print_settings(chip: str, family_id: int, device_id: int, settings, names: dict[int, str]):
+    print(f"{chip} (family 0x{family_id:X}, device 0x{device_id:04X}): {len(settings)} golden settings")
+    for offset, mask, value in settings:
+        print(f"  {reg_name(names, offset):40} mask 0x{mask:08X} value 0x{value:08X}")
+
+
+def print_diff(lred: dict[int, tuple[int, int]], amdgpu: dict[int, tuple[int, int]], names: dict[int, str]) -> int:
+    differences = 0
+    for offset in sorted(lred.keys() | amdgpu.keys()):
+        ours, theirs = lred.get(offset), amdgpu.get(offset)
+        if ours is not None and theirs is not None:
+            common = ours[0] & theirs[0]
+            if ours[0] == theirs[0] and (ours[1] ^ theirs[1]) & common == 0:
+                continue
+            line = f"mask 0x{ours[0]:08X}/0x{theirs[0]:08X} value 0x{ours[1]:08X}/0x{theirs[1]:08X}"
+            if (ours[1] ^ theirs[1]) & common:
+                line += f" conflicting bits 0x{(ours[1] ^ theirs[1]) & common:08X}"
+            print(f"~ {reg_name(names, offset):40} {line}")
+        elif ours is not None:
+            print(f"- {reg_name(names, offset):40} only in CAIL:   mask 0x{ours[0]:08X} value 0x{ours[1]:08X}")
+        else:
+            print(f"+ {reg_name(names, offset):40} only in amdgpu: mask 0x{theirs[0]:08X} value 0x{theirs[1]:08X}")
+        differences += 1
+    print(f"{differences} differences")
+    return differences
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode and diff the golden settings published by LegacyRed")
+    parser.add_argument("input", help="raw blob or `ioreg -a` output")
+    parser.add_argument("--amdgpu", type=pathlib.Path,
+                        help="path to a Linux `drivers/gpu/drm/amd/amdgpu` directory to diff against")
+    parser.add_argument("--chip", choices=CHIP_TYPES, help="override the chip recorded in the blob")
+    parser.add_argument("--common", type=pathlib.Path,
+                        default=pathlib.Path(__file__).resolve().parent.parent / "LegacyRed" / "AMDCommon.hpp",
+                        help="path to AMDCommon.hpp for register names")
+    args = parser.parse_args()
+
+    with open(args.input, "rb") as f:
+        chip, family_id, device_id, settings = parse_blob(find_blob(f.read()))
+    chip = args.chip or chip
+
+    names = parse_register_names(args.common) if args.common.exists() else {}
+    if args.amdgpu is None:
+        print_settings(chip, family_id, device_id, settings, names)
+        return
+
+    if chip not in AMDGPU_TABLES:
+        print(f"No amdgpu golden tables known for {chip}, use --chip")
+        sys.exit(1)
+    regs = parse_amdgpu_headers(args.amdgpu, chip)
+    for name, offset in regs.items():
+        names.setdefault(offset, name)
+
+    lred = {}
+    for offset, mask, value in settings:
+        apply(lred, offset, mask, value)
+    print(f"{chip} (family 0x{family_id:X}, device 0x{device_id:04X}): CAIL vs amdgpu")
+    sys.exit(1 if print_diff(lred, amdgpu_settings(args.amdgpu, chip, regs), names) else 0)
+
+
+if __name__ == "__main__":
+    main()
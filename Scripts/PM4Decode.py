@@ -0,0 +1,202 @@
+#!/usr/bin/python3
+
+# PM4 packet decoder for GFX7/GFX8 command streams.
+# Usable on its own against a raw little-endian dword capture, or imported by DecodeTrace.py.
+
+import struct
+import sys
+
+OPCODES = {
+    0x10: "NOP",
+    0x11: "SET_BASE",
+    0x12: "CLEAR_STATE",
+    0x13: "INDEX_BUFFER_SIZE",
+    0x15: "DISPATCH_DIRECT",
+    0x16: "DISPATCH_INDIRECT",
+    0x1D: "ATOMIC_GDS",
+    0x1E: "ATOMIC_MEM",
+    0x1F: "OCCLUSION_QUERY",
+    0x20: "SET_PREDICATION",
+    0x21: "REG_RMW",
+    0x22: "COND_EXEC",
+    0x23: "PRED_EXEC",
+    0x24: "DRAW_INDIRECT",
+    0x25: "DRAW_INDEX_INDIRECT",
+    0x26: "INDEX_BASE",
+    0x27: "DRAW_INDEX_2",
+    0x28: "CONTEXT_CONTROL",
+    0x2A: "INDEX_TYPE",
+    0x2C: "DRAW_INDIRECT_MULTI",
+    0x2D: "DRAW_INDEX_AUTO",
+    0x2F: "NUM_INSTANCES",
+    0x30: "DRAW_INDEX_MULTI_AUTO",
+    0x32: "INDIRECT_BUFFER_CONST",
+    0x33: "STRMOUT_BUFFER_UPDATE",
+    0x35: "DRAW_INDEX_OFFSET_2",
+    0x36: "DRAW_PREAMBLE",
+    0x37: "WRITE_DATA",
+    0x38: "DRAW_INDEX_INDIRECT_MULTI",
+    0x39: "MEM_SEMAPHORE",
+    0x3A: "COPY_DW",
+    0x3C: "WAIT_REG_MEM",
+    0x3F: "INDIRECT_BUFFER",
+    0x40: "COPY_DATA",
+    0x41: "CP_DMA",
+    0x42: "PFP_SYNC_ME",
+    0x43: "SURFACE_SYNC",
+    0x44: "ME_INITIALIZE",
+    0x45: "COND_WRITE",
+    0x46: "EVENT_WRITE",
+    0x47: "EVENT_WRITE_EOP",
+    0x48: "EVENT_WRITE_EOS",
+    0x49: "RELEASE_MEM",
+    0x4A: "PREAMBLE_CNTL",
+    0x50: "DMA_DATA",
+    0x57: "ACQUIRE_MEM",
+    0x58: "REWIND",
+    0x5E: "LOAD_UCONFIG_REG",
+    0x5F: "LOAD_SH_REG",
+    0x60: "LOAD_CONFIG_REG",
+    0x61: "LOAD_CONTEXT_REG",
+    0x68: "SET_CONFIG_REG",
+    0x69: "SET_CONTEXT_REG",
+    0x6A: "SET_CONTEXT_REG_INDIRECT",
+    0x76: "SET_SH_REG",
+    0x77: "SET_SH_REG_OFFSET",
+    0x78: "SET_QUEUE_REG",
+    0x79: "SET_UCONFIG_REG",
+    0x80: "LOAD_CONST_RAM",
+    0x81: "WRITE_CONST_RAM",
+    0x83: "DUMP_CONST_RAM",
+    0x84: "INCREMENT_CE_COUNTER",
+    0x85: "INCREMENT_DE_COUNTER",
+    0x86: "WAIT_ON_CE_COUNTER",
+    0x88: "WAIT_ON_DE_COUNTER_DIFF",
+    0x8B: "SWITCH_BUFFER",
+    0x90: "FRAME_CONTROL",
+    0xA0: "SET_RESOURCES",
+    0xA1: "MAP_PROCESS",
+    0xA2: "MAP_QUEUES",
+    0xA3: "UNMAP_QUEUES",
+    0xA4: "QUERY_STATUS",
+}
+
+# Register space base of the SET_*_REG packets, in dwords
+SET_REG_BASES = {
+    0x68: 0x2000,
+    0x69: 0xA000,
+    0x76: 0x2C00,
+    0x79: 0xC000,
+}
+
+WRITE_DATA_DST = {
+    0: "register",
+    1: "memory (sync)",
+    2: "TC L2",
+    3: "GDS",
+    5: "memory (async)",
+}
+
+
+def decode_set_reg(opcode: int, body: list[int]) -> list[str]:
+    if not body:
+        return []
+    reg = SET_REG_BASES[opcode] + (body[0] & 0xFFFF)
+    return [f"reg 0x{reg + i:X} = 0x{val:08X}" for i, val in enumerate(body[1:])]
+
+
+def decode_indirect_buffer(body: list[int]) -> list[str]:
+    if len(body) < 3:
+        return []
+    addr = ((body[1] & 0xFFFF) << 32) | (body[0] & 0xFFFFFFFC)
+    size = body[2] & 0xFFFFF
+    vmid = (body[2] >> 24) & 0xF
+    chain = (body[2] >> 20) & 1
+    return [f"addr 0x{addr:X} size {size} dwords vmid {vmid}{' chained' if chain else ''}"]
+
+
+def decode_write_data(body: list[int]) -> list[str]:
+    if len(body) < 3:
+        return []
+    dst_sel = (body[0] >> 8) & 0xF
+    dst = WRITE_DATA_DST.get(dst_sel, f"dst {dst_sel}")
+    confirm = " confirmed" if body[0] & (1 << 20) else ""
+    if dst_sel == 0:
+        target = f"reg 0x{body[1] & 0xFFFF:X}"
+    else:
+        target = f"0x{(body[2] << 32) | body[1]:X}"
+    lines = [f"{dst} {target}{confirm}, engine {(body[0] >> 30) & 3}"]
+    lines += [f"data 0x{val:08X}" for val in body[3:]]
+    return lines
+
+
+def decode_pm4(dwords: list[int]):
+    """Yields (offset, text) for each packet, and indented detail lines with offset None."""
+    i = 0
+    n = len(dwords)
+    while i < n:
+        header = dwords[i]
+        packet_type = header >> 30
+        if packet_type == 2:
+            yield i, "TYPE2 filler"
+            i += 1
+            continue
+        if packet_type == 0:
+            count = ((header >> 16) & 0x3FFF) + 1
+            reg = header & 0xFFFF
+            body = dwords[i + 1:i + 1 + count]
+            yield i, f"TYPE0 reg 0x{reg:X} count {count}"
+            for j, val in enumerate(body):
+                yield None, f"reg 0x{reg + j:X} = 0x{val:08X}"
+            i += 1 + count
+            continue
+        if packet_type != 3:
+            yield i, f"unknown packet 0x{header:08X}"
+            i += 1
+            continue
+
+        count = ((header >> 16) & 0x3FFF) + 1
+        opcode = (header >> 8) & 0xFF
+        name = OPCODES.get(opcode, f"OPCODE_0x{opcode:02X}")
+        body = dwords[i + 1:i + 1 + count]
+        flags = ""
+        if header & 2:
+            flags += " compute"
+        if header & 1:
+            flags += " predicated"
+        truncated = " (truncated)" if len(body) < count else ""
+        yield i, f"{name} count {count}{flags}{truncated}"
+
+        if opcode in SET_REG_BASES:
+            details = decode_set_reg(opcode, body)
+        elif opcode in (0x3F, 0x32):
+            details = decode_indirect_buffer(body)
+        elif opcode == 0x37:
+            details = decode_write_data(body)
+        else:
+            details = [" ".join(f"{val:08X}" for val in body)] if body else []
+        for line in details:
+            yield None, line
+        i += 1 + count
+
+
+def print_pm4(dwords: list[int], indent: str = ""):
+    for offset, text in decode_pm4(dwords):
+        if offset is None:
+            print(f"{indent}        {text}")
+        else:
+            print(f"{indent}{offset:6}: {text}")
+
+
+def main():
+    if len(sys.argv) != 2:
+        print(f"Usage: {sys.argv[0]} <raw dword capture>")
+        sys.exit(1)
+
+    with open(sys.argv[1], "rb") as f:
+        data = f.read()
+    print_pm4(list(struct.unpack(f"<{len(data) // 4}I", data[:len(data) // 4 * 4])))
+
+
+if __name__ == "__main__":
+    main()